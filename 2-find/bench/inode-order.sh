@@ -0,0 +1,46 @@
+#!/bin/sh
+# Compare stat(2)-ing in the order of the listing with -inode-order on a cold
+# cache. Needs root to mount a loop image and drop the page cache:
+#
+#     bench/inode-order.sh [FILES] [RUNS]
+#
+# ext4 lists big directories in hash order, which is unrelated to the order of
+# the inode tables the files were allocated in.
+set -eu
+
+files=${1:-200000}
+runs=${2:-5}
+find=$(realpath "$(dirname "$0")/../find")
+tmp=$(mktemp -d)
+trap 'umount "$tmp/mnt" 2> /dev/null; rm -rf "$tmp"' EXIT
+
+truncate -s 1G "$tmp/img"
+mkfs.ext4 -q -N $((files + 1000)) "$tmp/img"
+mkdir "$tmp/mnt"
+mount -o loop "$tmp/img" "$tmp/mnt"
+(
+	cd "$tmp/mnt"
+	i=0
+	while [ "$i" -lt 20 ]; do
+		mkdir "d$i"
+		i=$((i + 1))
+	done
+	seq "$files" | awk -v n="$files" '{ printf "d%d/f%d\n", ($1 - 1) * 20 / n, $1 }' | xargs touch
+)
+
+run() {
+	i=0
+	while [ "$i" -lt "$runs" ]; do
+		sync
+		echo 3 > /proc/sys/vm/drop_caches
+		start=$(date +%s%N)
+		"$@" >/dev/null
+		end=$(date +%s%N)
+		echo $(( (end - start) / 1000000 ))
+		i=$((i + 1))
+	done | sort -n | awk -v name="$*" '{ t[NR] = $1 } END { printf "%-50s median %d ms\n", name, t[int((NR + 1) / 2)] }'
+}
+
+run find "$tmp/mnt" -size +1k
+run "$find" "$tmp/mnt" -size +1k
+run "$find" -inode-order "$tmp/mnt" -size +1k
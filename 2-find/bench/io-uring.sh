@@ -0,0 +1,39 @@
+#!/bin/sh
+# Compare metadata operations per second of the synchronous path and
+# -io-uring on DIR, with the page cache dropped before every run if COLD=1
+# (root only):
+#
+#     COLD=1 bench/io-uring.sh /mnt/nvme [RUNS]
+#
+# Operations are the stat(2)s and directory opens reported by -stats.
+set -eu
+
+dir=$1
+runs=${2:-5}
+find=$(dirname "$0")/../find
+
+run() {
+	i=0
+	while [ "$i" -lt "$runs" ]; do
+		if [ "${COLD:-0}" = 1 ]; then
+			sync
+			echo 3 > /proc/sys/vm/drop_caches
+		fi
+		start=$(date +%s%N)
+		ops=$("$@" -stats 2>&1 >/dev/null | awk -F': ' '/directories opened|stats issued/ { n += $3 } END { print n }')
+		end=$(date +%s%N)
+		echo "$(( (end - start) / 1000000 )) $ops"
+		i=$((i + 1))
+	done | sort -n | awk -v name="$*" '
+		{ t[NR] = $1; ops[NR] = $2 }
+		END {
+			m = int((NR + 1) / 2)
+			printf "%-50s median %d ms, %d ops, %d ops/s\n", name, t[m], ops[m], ops[m] * 1000 / (t[m] ? t[m] : 1)
+		}'
+}
+
+run "$find" "$dir" -size +1k
+run "$find" -io-uring "$dir" -size +1k
+run "$find" -io-uring -inode-order "$dir" -size +1k
+run "$find" -threads 4 "$dir" -size +1k
+run "$find" -threads 4 -io-uring "$dir" -size +1k
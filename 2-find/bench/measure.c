@@ -0,0 +1,132 @@
+#define _GNU_SOURCE  // wait4, __WALL
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ *  Run a command and print what it cost on one line, for bench/run.sh:
+ *
+ *      measure [-s] COMMAND [ARG...]
+ *
+ *  Prints wall, user and system time in microseconds, the peak RSS in KiB
+ *  and the exit status, separated by tabs. With `-s` the command is traced
+ *  with ptrace(2) and the number of syscalls of all its threads is printed
+ *  instead of -1. Tracing stops the command twice per syscall, so its times
+ *  are useless then, and the two are measured in separate runs.
+ *
+ *  The command's output goes to /dev/null.
+ */
+
+static uint64_t measure_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t measure_us(struct timeval tv) {
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/**
+ *  Trace `pid`, which stopped itself before execvp(3), and all threads it
+ *  creates until it exits. Count the syscall-enter stops, they are reported by
+ *  `PTRACE_GET_SYSCALL_INFO`, so we do not have to track enter and exit per
+ *  thread. Returns the wait(2) status of `pid`.
+ */
+static int measure_trace(pid_t pid, uint64_t *syscalls) {
+	int status;
+	if(waitpid(pid, &status, 0) < 0) {
+		return -1;
+	}
+	long opts = PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL;
+	if(ptrace(PTRACE_SETOPTIONS, pid, 0, opts) < 0 || ptrace(PTRACE_SYSCALL, pid, 0, 0) < 0) {
+		return -1;
+	}
+	*syscalls = 0;
+	for(;;) {
+		pid_t tid = waitpid(-1, &status, __WALL);
+		if(tid < 0) {
+			return -1;
+		}
+		if(WIFEXITED(status) || WIFSIGNALED(status)) {
+			if(tid == pid) {
+				return status;
+			}
+			continue;
+		}
+		int sig = 0;
+		if(WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+			// the first member of `struct ptrace_syscall_info` is `op`
+			unsigned char info[128];
+			if(ptrace(PTRACE_GET_SYSCALL_INFO, tid, sizeof(info), info) > 0 && info[0] == PTRACE_SYSCALL_INFO_ENTRY) {
+				++*syscalls;
+			}
+		} else if(status >> 8 == (SIGTRAP | (PTRACE_EVENT_CLONE << 8))) {
+			// a new thread, it is traced already and starts with SIGSTOP
+		} else if(WSTOPSIG(status) != SIGSTOP && WSTOPSIG(status) != SIGTRAP) {
+			sig = WSTOPSIG(status);
+		}
+		ptrace(PTRACE_SYSCALL, tid, 0, sig);
+	}
+}
+
+int main(int argc, char **argv) {
+	int trace = argc > 1 && strcmp(argv[1], "-s") == 0;
+	if(argc < 2 + trace) {
+		fprintf(stderr, "Usage: %s [-s] COMMAND [ARG...]\n", argv[0]);
+		return 2;
+	}
+	char **cmd = &argv[1 + trace];
+
+	uint64_t start = measure_now();
+	pid_t pid = fork();
+	if(pid < 0) {
+		fprintf(stderr, "%s: cannot fork: %s\n", argv[0], strerror(errno));
+		return 1;
+	}
+	if(pid == 0) {
+		if(!freopen("/dev/null", "w", stdout)) {
+			_exit(127);
+		}
+		if(trace && (ptrace(PTRACE_TRACEME, 0, 0, 0) < 0 || raise(SIGSTOP) != 0)) {
+			_exit(127);
+		}
+		execvp(cmd[0], cmd);
+		fprintf(stderr, "%s: cannot run %s: %s\n", argv[0], cmd[0], strerror(errno));
+		_exit(127);
+	}
+
+	struct rusage ru;
+	int status;
+	uint64_t syscalls = 0;
+	if(trace) {
+		status = measure_trace(pid, &syscalls);
+		getrusage(RUSAGE_CHILDREN, &ru);
+	} else if(wait4(pid, &status, 0, &ru) < 0) {
+		status = -1;
+	}
+	if(status < 0) {
+		fprintf(stderr, "%s: cannot wait for %s: %s\n", argv[0], cmd[0], strerror(errno));
+		return 1;
+	}
+	uint64_t wall = measure_now() - start;
+
+	printf(
+		"%llu\t%llu\t%llu\t%ld\t%d\t%lld\n",
+		(unsigned long long)wall,
+		(unsigned long long)measure_us(ru.ru_utime),
+		(unsigned long long)measure_us(ru.ru_stime),
+		ru.ru_maxrss,
+		WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status),
+		trace ? (long long)syscalls : -1LL
+	);
+	return 0;
+}
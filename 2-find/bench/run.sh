@@ -0,0 +1,149 @@
+#!/bin/sh
+# Time find against GNU find on the synthetic trees of bench/tree.sh, run by
+# `make bench`:
+#
+#     BENCH_RUNS=5 BENCH_TREES='wide deep symlinks mixed' bench/run.sh
+#
+# The trees are created once in BENCH_DIR (/tmp/find-bench) and reused, delete
+# it after changing tree.sh. Every tool runs BENCH_RUNS times per tree and
+# query with a warm cache, and with a cold one if we may write to
+# /proc/sys/vm/drop_caches (root). A run with ptrace(2) counts the syscalls.
+#
+# `-delete` is timed against `rm -rf` on copies of the BENCH_DELETE trees
+# (wide mixed, empty for none), with a warm cache.
+#
+# Every run is a line in BENCH_OUT (bench/results.tsv), tab-separated with a
+# header, times in microseconds and the peak RSS in KiB. The medians are
+# printed at the end.
+set -eu
+
+bench=$(cd "$(dirname "$0")" && pwd)
+find=$bench/../find
+measure=$bench/measure
+dir=${BENCH_DIR:-/tmp/find-bench}
+runs=${BENCH_RUNS:-5}
+out=${BENCH_OUT:-$bench/results.tsv}
+trees=${BENCH_TREES:-wide deep symlinks mixed}
+threads=${BENCH_THREADS:-$(nproc)}
+delete_trees=${BENCH_DELETE-wide mixed}
+
+caches=warm
+if [ -w /proc/sys/vm/drop_caches ]; then
+	caches='warm cold'
+else
+	echo "$0: cold cache runs need root, skipping them" >&2
+fi
+
+mkdir -p "$dir"
+for tree in $trees $delete_trees; do
+	# a tree that was interrupted is created again
+	if [ ! -e "$dir/$tree.done" ]; then
+		echo "creating $tree in $dir" >&2
+		rm -rf "${dir:?}/$tree"
+		"$bench/tree.sh" "$tree" "$dir/$tree"
+		touch "$dir/$tree.done"
+	fi
+done
+
+# run TREE CACHE TOOL QUERY COMMAND...: measure COMMAND and append the runs
+run() {
+	tree=$1 cache=$2 tool=$3 query=$4
+	shift 4
+	syscalls=$("$measure" -s "$@" 2> /dev/null | cut -f 6) || syscalls=-1
+	i=0
+	while [ "$i" -lt "$runs" ]; do
+		if [ "$cache" = cold ]; then
+			sync
+			echo 3 > /proc/sys/vm/drop_caches
+		fi
+		"$measure" "$@" 2> /dev/null | awk -v OFS='\t' -v pre="$tree	$cache	$tool	$query	$i" -v syscalls="$syscalls" \
+			'{ print pre, $1, $2, $3, $4, $5, syscalls }' >> "$out"
+		i=$((i + 1))
+	done
+}
+
+# run_delete TREE TOOL COMMAND...: like `run` with a warm cache, COMMAND
+# removes $dir/delete, which is copied from TREE before every run
+run_delete() {
+	tree=$1 tool=$2
+	shift 2
+	rm -rf "$dir/delete"
+	cp -a "$dir/$tree" "$dir/delete"
+	syscalls=$("$measure" -s "$@" 2> /dev/null | cut -f 6) || syscalls=-1
+	i=0
+	while [ "$i" -lt "$runs" ]; do
+		rm -rf "$dir/delete"
+		cp -a "$dir/$tree" "$dir/delete"
+		"$measure" "$@" 2> /dev/null | awk -v OFS='\t' -v pre="$tree	warm	$tool	delete	$i" -v syscalls="$syscalls" \
+			'{ print pre, $1, $2, $3, $4, $5, syscalls }' >> "$out"
+		i=$((i + 1))
+	done
+	rm -rf "$dir/delete"
+}
+
+printf 'tree\tcache\ttool\tquery\trun\twall_us\tuser_us\tsys_us\tmaxrss_kb\tstatus\tsyscalls\n' > "$out"
+for tree in $trees; do
+	root=$dir/$tree
+	# symlinks are only interesting when followed
+	follow=
+	if [ "$tree" = symlinks ]; then
+		follow=-L
+	fi
+	for cache in $caches; do
+		for query in all size; do
+			expr=
+			if [ "$query" = size ]; then
+				expr='-size +1k'
+			fi
+			echo "running $tree $cache $query" >&2
+			# $follow and $expr are split on purpose
+			run "$tree" "$cache" gnu-find "$query" find $follow "$root" $expr
+			run "$tree" "$cache" find "$query" "$find" $follow "$root" $expr
+			if [ "$threads" -gt 1 ]; then
+				run "$tree" "$cache" "find-threads-$threads" "$query" "$find" $follow -threads "$threads" "$root" $expr
+			fi
+			if [ "$tree" = symlinks ]; then
+				run "$tree" "$cache" find-unique "$query" "$find" $follow -unique "$root" $expr
+			fi
+		done
+	done
+done
+for tree in $delete_trees; do
+	echo "running $tree delete" >&2
+	run_delete "$tree" rm-rf rm -rf "$dir/delete"
+	run_delete "$tree" find "$find" "$dir/delete" -delete
+	if [ "$threads" -gt 1 ]; then
+		run_delete "$tree" "find-threads-$threads" "$find" -threads "$threads" "$dir/delete" -delete
+	fi
+done
+
+# medians per tree, cache, tool and query
+awk -F '\t' '
+	NR > 1 {
+		key = $1 "\t" $2 "\t" $4 "\t" $3
+		if(!(key in n)) {
+			keys[++nkeys] = key
+		}
+		++n[key]
+		wall[key, n[key]] = $6; user[key, n[key]] = $7; sys[key, n[key]] = $8
+		rss[key] = $9 > rss[key] ? $9 : rss[key]; calls[key] = $11
+	}
+	function median(a, key, m, i, j, t, v) {
+		m = n[key]
+		for(i = 1; i <= m; ++i) {
+			v[i] = a[key, i]
+		}
+		for(i = 2; i <= m; ++i) {
+			for(j = i; j > 1 && v[j - 1] > v[j]; --j) {
+				t = v[j]; v[j] = v[j - 1]; v[j - 1] = t
+			}
+		}
+		return v[int((m + 1) / 2)]
+	}
+	END {
+		printf "%-9s %-5s %-6s %-16s %10s %10s %10s %10s %10s\n", "tree", "cache", "query", "tool", "wall_ms", "user_ms", "sys_ms", "rss_kb", "syscalls"
+		for(k = 1; k <= nkeys; ++k) {
+			split(keys[k], f, "\t")
+			printf "%-9s %-5s %-6s %-16s %10.1f %10.1f %10.1f %10d %10d\n", f[1], f[2], f[3], f[4], median(wall, keys[k]) / 1000, median(user, keys[k]) / 1000, median(sys, keys[k]) / 1000, rss[keys[k]], calls[keys[k]]
+		}
+	}' "$out"
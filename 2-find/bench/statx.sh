@@ -0,0 +1,28 @@
+#!/bin/sh
+# Compare stat(2)-heavy traversals of DIR, meant for a FUSE or NFS mount, e.g.
+# `bindfs /usr /mnt/usr` standing in for a network file system:
+#
+#     bench/statx.sh /mnt/usr [RUNS]
+#
+# GNU find stats the full `struct stat`, ./find asks statx(2) for the type and
+# size only, and -dont-sync lets the file system answer from its cache.
+set -eu
+
+dir=$1
+runs=${2:-5}
+find=$(dirname "$0")/../find
+
+run() {
+	i=0
+	while [ "$i" -lt "$runs" ]; do
+		start=$(date +%s%N)
+		"$@" >/dev/null
+		end=$(date +%s%N)
+		echo $(( (end - start) / 1000000 ))
+		i=$((i + 1))
+	done | sort -n | awk -v name="$*" '{ t[NR] = $1 } END { printf "%-50s median %d ms\n", name, t[int((NR + 1) / 2)] }'
+}
+
+run find "$dir" -size +1k
+run "$find" "$dir" -size +1k
+run "$find" -dont-sync "$dir" -size +1k
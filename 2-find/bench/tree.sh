@@ -0,0 +1,119 @@
+#!/bin/sh
+# Create a synthetic tree for bench/run.sh in DIR, which must not exist:
+#
+#     bench/tree.sh wide|deep|symlinks|mixed DIR
+#
+# wide      BENCH_WIDE files (1000000) in one directory
+# deep      BENCH_DEEP levels (10000) of directories with a file on each
+# mixed     a source tree: BENCH_MIXED files (200000) in directories with a
+#           skewed fanout, common extensions, every tenth file 4 KiB big and
+#           a .git with an object store in every project
+# symlinks  a mixed tree of a tenth of the size in real/, and BENCH_LINKS
+#           (50) symlinks to it and to its projects in links/, so -follow
+#           traverses it many times
+#
+# The tree is the same for every run, the random generator has a fixed seed.
+set -eu
+
+kind=$1
+dir=$2
+
+# mixed SEED FILES: print "d PATH" and "f PATH SIZE" for a mixed tree.
+mixed() {
+	awk -v seed="$1" -v files="$2" '
+	BEGIN {
+		srand(seed)
+		split("c h cc py js ts go rs md txt json o a so png", ext, " ")
+		nprojects = 0
+		n = 0
+		q[0] = "."; qd[0] = 0; head = 0; tail = 1
+		while(head < tail && n < files) {
+			d = q[head]; depth = qd[head]; ++head
+			if(depth == 1) {
+				# every project has a git repository
+				print "d " d "/.git/objects"
+				for(i = 0; i < 16 && n < files; ++i) {
+					o = sprintf("%s/.git/objects/%02x", d, int(rand() * 256))
+					print "d " o
+					for(j = 0; j < 8 && n < files; ++j) {
+						printf "f %s/%038x 0\n", o, n; ++n
+					}
+				}
+			}
+			nfiles = int(rand() * rand() * 60)
+			for(i = 0; i < nfiles && n < files; ++i) {
+				size = n % 10 == 0 ? 4096 : 0
+				print "f " d "/file" i "." ext[int(rand() * 15) + 1] " " size; ++n
+			}
+			nsub = depth == 0 ? 20 : depth < 8 ? int(rand() * rand() * rand() * 16) : 0
+			for(i = 0; i < nsub; ++i) {
+				s = d "/" (depth == 0 ? "project" nprojects++ : "dir" i)
+				print "d " s
+				q[tail] = s; qd[tail] = depth + 1; ++tail
+			}
+			# start another project until we have enough files
+			if(head == tail && n < files) {
+				s = "./project" nprojects++
+				print "d " s
+				q[tail] = s; qd[tail] = 1; ++tail
+			}
+		}
+	}'
+}
+
+# create: read the output of mixed in the current directory
+create() {
+	list=$(mktemp)
+	cat > "$list"
+	awk '$1 == "d" { print $2 }' "$list" | xargs mkdir -p
+	awk '$1 == "f" { print $2 }' "$list" | xargs touch
+	awk '$1 == "f" && $3 > 0 { print $2 }' "$list" | xargs -r truncate -s 4096
+	rm "$list"
+}
+
+mkdir "$dir"
+cd "$dir"
+case "$kind" in
+wide)
+	seq -f 'file%.0f' "${BENCH_WIDE:-1000000}" | xargs touch
+	;;
+deep)
+	# Paths must stay below PATH_MAX, so the tree is built bottom up from
+	# chunks of 100 levels, each chunk is moved into the bottom of the next.
+	levels=${BENCH_DEEP:-10000}
+	prev=
+	while [ "$levels" -gt 0 ]; do
+		n=$((levels < 100 ? levels : 100))
+		chunk=chunk$levels
+		bottom=$chunk/$(seq "$n" | awk '{ printf "d/" }')
+		mkdir -p "$bottom"
+		# a file on every level
+		seq "$n" | awk -v c="$chunk" '{ p = p "/d"; print c p "/f" }' | xargs touch
+		if [ -n "$prev" ]; then
+			mv "$prev/d" "$bottom"
+			rmdir "$prev"
+		fi
+		prev=$chunk
+		levels=$((levels - n))
+	done
+	mv "$prev/d" .
+	rmdir "$prev"
+	;;
+mixed)
+	mixed 42 "${BENCH_MIXED:-200000}" | create
+	;;
+symlinks)
+	mkdir real links
+	(cd real && mixed 43 $(( ${BENCH_MIXED:-200000} / 10 )) | create)
+	i=0
+	while [ "$i" -lt "${BENCH_LINKS:-50}" ]; do
+		ln -s ../real "links/all$i"
+		ln -s "../real/project$((i % 20))" "links/project$i"
+		i=$((i + 1))
+	done
+	;;
+*)
+	echo "$0: unknown tree: $kind" >&2
+	exit 2
+	;;
+esac
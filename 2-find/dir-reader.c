@@ -0,0 +1,77 @@
+#define _GNU_SOURCE  // getdents64
+#include <dirent.h>
+#include <errno.h>
+#include <stdlib.h>
+
+#include "dir-reader.h"
+
+void dir_reader_init(struct dir_reader *r, int fd, struct dir_buffer *buf) {
+	*r = (struct dir_reader){
+		.fd = fd,
+		.buf = buf,
+		.pos = 0,
+		.end = 0,
+	};
+}
+
+/**
+ *  Like `dir_reader_init`, for a directory whose first getdents64(2) batch of
+ *  `len` bytes was read into `buf` already, see `struct prefetch`.
+ */
+void dir_reader_init_read(struct dir_reader *r, int fd, struct dir_buffer *buf, size_t len) {
+	dir_reader_init(r, fd, buf);
+	r->end = len;
+}
+
+/**
+ *  Store the next entry of `r` in `e`, "." and ".." are returned as well.
+ *  Returns 1 if there was an entry, 0 at the end of the directory, and -1 on
+ *  error with `errno` set.
+ */
+int dir_reader_next(struct dir_reader *r, struct dir_entry *e) {
+	if(r->pos >= r->end) {
+		struct dir_buffer *buf = r->buf;
+		// Grow the buffer if the previous call filled most of it, because then
+		// the directory is big and we save syscalls by reading more at once.
+		size_t size = buf->size;
+		if(!buf->data) {
+			size = DIR_BUFFER_MIN;
+		} else if(r->end > buf->size / 2 && buf->size < DIR_BUFFER_MAX) {
+			size = buf->size * 2;
+		}
+		if(size != buf->size || !buf->data) {
+			char *data = realloc(buf->data, size);
+			if(data) {
+				buf->data = data;
+				buf->size = size;
+			} else if(!buf->data) {
+				return -1;
+			}
+		}
+
+		ssize_t n = getdents64(r->fd, buf->data, buf->size);
+		if(n < 0) {
+			return -1;
+		}
+		r->pos = 0;
+		r->end = n;
+		if(n == 0) {
+			return 0;
+		}
+	}
+
+	struct dirent64 *d = (struct dirent64 *)(r->buf->data + r->pos);
+	r->pos += d->d_reclen;
+	*e = (struct dir_entry){
+		.ino = d->d_ino,
+		.type = d->d_type,
+		.name = d->d_name,
+	};
+	return 1;
+}
+
+void dir_buffer_free(struct dir_buffer *buf) {
+	free(buf->data);
+	buf->data = NULL;
+	buf->size = 0;
+}
@@ -0,0 +1,52 @@
+#ifndef DIR_READER_H
+#define DIR_READER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ *  Buffer for `getdents64(2)` owned by the caller of `dir_reader_init`, so it
+ *  can be reused for many directories. `dir_reader_next` grows it up to
+ *  `DIR_BUFFER_MAX` when a directory does not fit.
+ */
+struct dir_buffer {
+	char *data;
+	size_t size;
+};
+
+#define DIR_BUFFER_MIN (32 * 1024)
+#define DIR_BUFFER_MAX (1024 * 1024)
+
+/**
+ *  Reads directory entries straight from a directory file descriptor with
+ *  `getdents64(2)`, instead of `fdopendir(3)` and `readdir(3)`, which would
+ *  take ownership of the file descriptor and use a small buffer of their own.
+ *  `pos` and `end` delimit the records in `buf->data` not returned yet.
+ */
+struct dir_reader {
+	int fd;
+	struct dir_buffer *buf;
+	size_t pos;
+	size_t end;
+};
+
+/**
+ *  An entry returned by `dir_reader_next`. `name` points into the reader's
+ *  buffer and is valid until the next call. `type` is `d_type` and may be
+ *  `DT_UNKNOWN`.
+ */
+struct dir_entry {
+	ino_t ino;
+	unsigned char type;
+	const char *name;
+};
+
+void dir_reader_init(struct dir_reader *r, int fd, struct dir_buffer *buf);
+
+void dir_reader_init_read(struct dir_reader *r, int fd, struct dir_buffer *buf, size_t len);
+
+int dir_reader_next(struct dir_reader *r, struct dir_entry *e);
+
+void dir_buffer_free(struct dir_buffer *buf);
+
+#endif
@@ -0,0 +1,250 @@
+#define _GNU_SOURCE  // qsort_r
+#include <errno.h>
+#include <limits.h>  // NAME_MAX
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dir-sort.h"
+
+/**
+ *  A spilled record: 8 bytes `ino`, 1 byte type and the null-terminated name.
+ */
+#define DIR_SORT_RECORD_MAX (8 + 1 + NAME_MAX + 1)
+
+static int dir_sort_cmp(const void *a, const void *b, void *names) {
+	return strcmp(
+		(const char *)names + ((const struct dir_sort_entry *)a)->name,
+		(const char *)names + ((const struct dir_sort_entry *)b)->name
+	);
+}
+
+static int dir_sort_add(struct dir_sort *s, const struct dir_entry *e) {
+	size_t n = strlen(e->name) + 1;
+	if(s->nentries == s->cap) {
+		size_t cap = s->cap ? s->cap * 2 : 256;
+		struct dir_sort_entry *entries = realloc(s->entries, cap * sizeof(*entries));
+		if(!entries) {
+			return -1;
+		}
+		s->entries = entries;
+		s->cap = cap;
+	}
+	if(s->names_len + n > s->names_cap) {
+		size_t cap = s->names_cap ? s->names_cap : 4096;
+		while(s->names_len + n > cap) {
+			cap *= 2;
+		}
+		char *names = realloc(s->names, cap);
+		if(!names) {
+			return -1;
+		}
+		s->names = names;
+		s->names_cap = cap;
+	}
+	memcpy(s->names + s->names_len, e->name, n);
+	s->entries[s->nentries++] = (struct dir_sort_entry){
+		.ino = e->ino,
+		.type = e->type,
+		.name = s->names_len,
+	};
+	s->names_len += n;
+	return 0;
+}
+
+/**
+ *  Sort the arena and append it to the spill file as a run, then empty it.
+ */
+static int dir_sort_spill(struct dir_sort *s) {
+	if(!s->spill && !(s->spill = tmpfile())) {
+		return -1;
+	}
+	struct dir_sort_run *runs = realloc(s->runs, (s->nruns + 1) * sizeof(*runs));
+	if(!runs) {
+		return -1;
+	}
+	s->runs = runs;
+
+	qsort_r(s->entries, s->nentries, sizeof(*s->entries), dir_sort_cmp, s->names);
+	off_t start = s->nruns > 0 ? s->runs[s->nruns - 1].end : 0;
+	off_t end = start;
+	for(size_t i = 0; i < s->nentries; ++i) {
+		const struct dir_sort_entry *e = &s->entries[i];
+		uint64_t ino = e->ino;
+		const char *name = s->names + e->name;
+		size_t n = strlen(name) + 1;
+		if(
+			fwrite(&ino, sizeof(ino), 1, s->spill) != 1
+			|| putc(e->type, s->spill) == EOF
+			|| fwrite(name, 1, n, s->spill) != n
+		) {
+			return -1;
+		}
+		end += sizeof(ino) + 1 + n;
+	}
+	// the runs are read with pread(2)
+	if(fflush(s->spill) == EOF) {
+		return -1;
+	}
+	s->runs[s->nruns++] = (struct dir_sort_run){
+		.pos = start,
+		.end = end,
+	};
+	s->nentries = 0;
+	s->names_len = 0;
+	return 0;
+}
+
+/**
+ *  Make the next record of `run` its `head`, `has_head` is 0 at its end.
+ */
+static int dir_sort_run_advance(struct dir_sort *s, struct dir_sort_run *run) {
+	run->has_head = 0;
+	if(!run->buf && !(run->buf = malloc(DIR_SORT_RUN_BUFFER))) {
+		return -1;
+	}
+	if(run->blen - run->bpos < DIR_SORT_RECORD_MAX && run->pos < run->end) {
+		memmove(run->buf, run->buf + run->bpos, run->blen - run->bpos);
+		run->blen -= run->bpos;
+		run->bpos = 0;
+		size_t want = DIR_SORT_RUN_BUFFER - run->blen;
+		if((off_t)want > run->end - run->pos) {
+			want = run->end - run->pos;
+		}
+		ssize_t n = pread(fileno(s->spill), run->buf + run->blen, want, run->pos);
+		if(n <= 0) {
+			if(n == 0) {
+				errno = EIO;
+			}
+			return -1;
+		}
+		run->pos += n;
+		run->blen += n;
+	}
+	if(run->bpos >= run->blen) {
+		return 0;
+	}
+	const char *p = run->buf + run->bpos;
+	uint64_t ino;
+	memcpy(&ino, p, sizeof(ino));
+	run->head = (struct dir_entry){
+		.ino = ino,
+		.type = (unsigned char)p[sizeof(ino)],
+		.name = p + sizeof(ino) + 1,
+	};
+	run->bpos += sizeof(ino) + 1 + strlen(run->head.name) + 1;
+	run->has_head = 1;
+	return 0;
+}
+
+/**
+ *  Read all entries of `r` and sort them. If reading fails, the entries read
+ *  until then are returned by `dir_sort_next` before the error.
+ */
+int dir_sort_read(struct dir_sort *s, struct dir_reader *r) {
+	dir_sort_reset(s);
+	struct dir_entry e;
+	int n;
+	while((n = dir_reader_next(r, &e)) > 0) {
+		if(
+			dir_sort_add(s, &e) < 0
+			|| (
+				s->nentries * sizeof(*s->entries) + s->names_len >= DIR_SORT_RUN_MAX
+				&& dir_sort_spill(s) < 0
+			)
+		) {
+			n = -1;
+			break;
+		}
+	}
+	if(n < 0) {
+		s->err = errno;
+	}
+	qsort_r(s->entries, s->nentries, sizeof(*s->entries), dir_sort_cmp, s->names);
+	for(size_t i = 0; i < s->nruns; ++i) {
+		if(dir_sort_run_advance(s, &s->runs[i]) < 0 && !s->err) {
+			s->err = errno;
+		}
+	}
+	return s->err ? -1 : 0;
+}
+
+/**
+ *  Store the next entry in `e`, like `dir_reader_next`. `e->name` is valid
+ *  until the next call.
+ */
+int dir_sort_next(struct dir_sort *s, struct dir_entry *e) {
+	if(s->last) {
+		if(dir_sort_run_advance(s, s->last) < 0 && !s->err) {
+			s->err = errno;
+		}
+		s->last = NULL;
+	}
+	const char *best = s->next < s->nentries ? s->names + s->entries[s->next].name : NULL;
+	struct dir_sort_run *best_run = NULL;
+	for(size_t i = 0; i < s->nruns; ++i) {
+		struct dir_sort_run *run = &s->runs[i];
+		if(run->has_head && (!best || strcmp(run->head.name, best) < 0)) {
+			best = run->head.name;
+			best_run = run;
+		}
+	}
+	if(!best) {
+		if(s->err) {
+			errno = s->err;
+			s->err = 0;
+			return -1;
+		}
+		return 0;
+	}
+	if(best_run) {
+		*e = best_run->head;
+		s->last = best_run;
+	} else {
+		const struct dir_sort_entry *m = &s->entries[s->next++];
+		*e = (struct dir_entry){
+			.ino = m->ino,
+			.type = m->type,
+			.name = best,
+		};
+	}
+	return 1;
+}
+
+/**
+ *  Forget the directory, called when we leave it. The arena is kept for the
+ *  next directory unless it grew big.
+ */
+void dir_sort_reset(struct dir_sort *s) {
+	if(s->spill) {
+		fclose(s->spill);
+		s->spill = NULL;
+	}
+	for(size_t i = 0; i < s->nruns; ++i) {
+		free(s->runs[i].buf);
+	}
+	free(s->runs);
+	s->runs = NULL;
+	s->nruns = 0;
+	s->last = NULL;
+	s->nentries = 0;
+	s->names_len = 0;
+	s->next = 0;
+	s->err = 0;
+	if(s->cap * sizeof(*s->entries) + s->names_cap > DIR_SORT_KEEP) {
+		free(s->entries);
+		free(s->names);
+		s->entries = NULL;
+		s->names = NULL;
+		s->cap = 0;
+		s->names_cap = 0;
+	}
+}
+
+void dir_sort_free(struct dir_sort *s) {
+	dir_sort_reset(s);
+	free(s->entries);
+	free(s->names);
+	*s = (struct dir_sort){0};
+}
@@ -0,0 +1,90 @@
+#ifndef DIR_SORT_H
+#define DIR_SORT_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "dir-reader.h"
+
+/**
+ *  Bytes of entries and names a run may hold in memory. Bigger directories are
+ *  sorted in runs of this size that are spilled to a temporary file and merged.
+ */
+#ifndef DIR_SORT_RUN_MAX
+#define DIR_SORT_RUN_MAX (8 * 1024 * 1024)
+#endif
+
+/**
+ *  Arenas bigger than this are freed by `dir_sort_reset` instead of being kept
+ *  for the next directory.
+ */
+#define DIR_SORT_KEEP (256 * 1024)
+
+/**
+ *  Read buffer of a spilled run, see `struct dir_sort`.
+ */
+#define DIR_SORT_RUN_BUFFER (16 * 1024)
+
+struct dir_sort_entry {
+	ino_t ino;
+	unsigned char type;
+	size_t name;
+};
+
+/**
+ *  A spilled run: records between `pos` and `end` of the spill file, the ones
+ *  read already are in `buf` between `bpos` and `blen`.
+ */
+struct dir_sort_run {
+	off_t pos;
+	off_t end;
+	char *buf;
+	size_t bpos;
+	size_t blen;
+	struct dir_entry head;
+	int has_head;
+};
+
+/**
+ *  All entries of a directory, sorted by name with strcmp(3), for `-sorted`.
+ *
+ *  `entries` and `names` are an arena for the directory's entries, they are
+ *  reset but kept for the next directory if they are small. `next` is the next
+ *  entry to return.
+ *
+ *  If a directory has more than `DIR_SORT_RUN_MAX` bytes of entries, the
+ *  sorted arena is appended to `spill` as a run of records (`ino_t`, type,
+ *  null-terminated name) and reused. The in-memory entries are the last run,
+ *  `dir_sort_next` merges it with the spilled `runs`. `last` is the run
+ *  whose head was returned last, it is advanced by the next call, so the
+ *  returned name stays valid until then.
+ *
+ *  `err` is the `errno` of a failed read, reported after the entries that
+ *  could be read.
+ *
+ *  A zeroed `struct dir_sort` is empty.
+ */
+struct dir_sort {
+	struct dir_sort_entry *entries;
+	size_t nentries;
+	size_t cap;
+	char *names;
+	size_t names_len;
+	size_t names_cap;
+	size_t next;
+	FILE *spill;
+	struct dir_sort_run *runs;
+	size_t nruns;
+	struct dir_sort_run *last;
+	int err;
+};
+
+int dir_sort_read(struct dir_sort *s, struct dir_reader *r);
+
+int dir_sort_next(struct dir_sort *s, struct dir_entry *e);
+
+void dir_sort_reset(struct dir_sort *s);
+
+void dir_sort_free(struct dir_sort *s);
+
+#endif
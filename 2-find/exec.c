@@ -0,0 +1,422 @@
+#define _GNU_SOURCE  // posix_spawn_file_actions_addchdir_np, strndup
+#include <errno.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "exec.h"
+
+extern char **environ;
+
+static pid_t exec_one_pid;
+
+/**
+ *  State shared by all batches, protected by `lock`. `running` batches are
+ *  reaped once `max` run at the same time. `pids` are the `npids` of them
+ *  nobody waits for yet, oldest first. They are reaped by their pid, never
+ *  with waitpid(-1, ...), which could steal the child of a `;` command from
+ *  the thread waiting for it. The lock is not held while waiting, `reaped` is
+ *  signalled whenever a batch was reaped. `failed` is set if a batch did not
+ *  exit with 0. `limit` is how many bytes of arguments a command may have, see
+ *  `exec_init`.
+ */
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t reaped;
+	size_t max;
+	pid_t *pids;
+	size_t npids;
+	size_t running;
+	int failed;
+	size_t limit;
+} exec_jobs = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.reaped = PTHREAD_COND_INITIALIZER,
+	.max = 1,
+	.pids = &exec_one_pid,
+	.npids = 0,
+	.running = 0,
+	.failed = 0,
+	.limit = 128 * 1024,
+};
+
+/**
+ *  Run at most `jobs` batches at the same time. The argument limit is
+ *  `ARG_MAX` minus the environment the children inherit, and some room like
+ *  xargs(1) leaves.
+ */
+int exec_init(size_t jobs) {
+	if(jobs > 1) {
+		exec_jobs.pids = malloc(jobs * sizeof(*exec_jobs.pids));
+		if(!exec_jobs.pids) {
+			exec_jobs.pids = &exec_one_pid;
+			return -1;
+		}
+	}
+	exec_jobs.max = jobs;
+	long arg_max = sysconf(_SC_ARG_MAX);
+	if(arg_max <= 0) {
+		return 0;
+	}
+	size_t reserve = sizeof(*environ) + 2048;
+	for(char **e = environ; *e; ++e) {
+		reserve += strlen(*e) + 1 + sizeof(*e);
+	}
+	if((size_t)arg_max <= reserve) {
+		errno = E2BIG;
+		return -1;
+	}
+	exec_jobs.limit = arg_max - reserve;
+	return 0;
+}
+
+/**
+ *  What the command line without any files counts against the limit.
+ */
+static size_t exec_base_size(const struct exec_cmd *cmd) {
+	size_t size = sizeof(*cmd->argv);
+	for(size_t i = 0; i < cmd->argc; ++i) {
+		size += strlen(cmd->argv[i]) + 1 + sizeof(*cmd->argv);
+	}
+	return size;
+}
+
+/**
+ *  The strings in `argv` are borrowed and have to outlive the command.
+ */
+struct exec_cmd *exec_new(char **argv, size_t argc, int batch, int dir, const char *prog) {
+	struct exec_cmd *cmd = calloc(1, sizeof(*cmd));
+	if(!cmd) {
+		return NULL;
+	}
+	int err = pthread_mutex_init(&cmd->lock, NULL);
+	if(err != 0) {
+		free(cmd);
+		errno = err;
+		return NULL;
+	}
+	cmd->argv = malloc(argc * sizeof(*argv));
+	if(!cmd->argv) {
+		pthread_mutex_destroy(&cmd->lock);
+		free(cmd);
+		return NULL;
+	}
+	memcpy(cmd->argv, argv, argc * sizeof(*argv));
+	cmd->argc = argc;
+	cmd->batch = batch;
+	cmd->dir = dir;
+	cmd->prog = prog;
+	cmd->size = exec_base_size(cmd);
+	return cmd;
+}
+
+void exec_free(struct exec_cmd *cmd) {
+	if(!cmd) {
+		return;
+	}
+	pthread_mutex_destroy(&cmd->lock);
+	free(cmd->argv);
+	free(cmd->args);
+	free(cmd->args_dir);
+	free(cmd);
+}
+
+/**
+ *  Spawn `argv` in `dir`, or the current directory if `dir` is `NULL`.
+ *  posix_spawn(3) uses vfork(2) semantics, so the cost of starting a child
+ *  does not grow with our memory.
+ */
+static int exec_spawn(const struct exec_cmd *cmd, char **argv, const char *dir, pid_t *pid) {
+	posix_spawn_file_actions_t actions;
+	int err = 0;
+	if(dir) {
+		err = posix_spawn_file_actions_init(&actions);
+		if(err != 0) {
+			goto fail;
+		}
+		err = posix_spawn_file_actions_addchdir_np(&actions, dir);
+		if(err == 0) {
+			err = posix_spawnp(pid, argv[0], &actions, NULL, argv, environ);
+		}
+		posix_spawn_file_actions_destroy(&actions);
+	} else {
+		err = posix_spawnp(pid, argv[0], NULL, NULL, argv, environ);
+	}
+	if(err == 0) {
+		return 0;
+	}
+fail:
+	fprintf(stderr, "%s: cannot execute %s: %s\n", cmd->prog, argv[0], strerror(err));
+	errno = err;
+	return -1;
+}
+
+/**
+ *  Wait for the oldest batch nobody waits for yet, or, if other threads wait
+ *  for all of them, until one of them is done. `exec_jobs.lock` must be held,
+ *  it is released while waiting.
+ */
+static void exec_reap(void) {
+	if(exec_jobs.npids == 0) {
+		pthread_cond_wait(&exec_jobs.reaped, &exec_jobs.lock);
+		return;
+	}
+	pid_t pid = exec_jobs.pids[0];
+	--exec_jobs.npids;
+	memmove(exec_jobs.pids, exec_jobs.pids + 1, exec_jobs.npids * sizeof(*exec_jobs.pids));
+	pthread_mutex_unlock(&exec_jobs.lock);
+	int status;
+	pid_t ret;
+	while((ret = waitpid(pid, &status, 0)) < 0 && errno == EINTR) {
+	}
+	pthread_mutex_lock(&exec_jobs.lock);
+	--exec_jobs.running;
+	if(ret < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		exec_jobs.failed = 1;
+	}
+	pthread_cond_broadcast(&exec_jobs.reaped);
+}
+
+/**
+ *  Run `argv` for `;` and wait for it. Returns 1 if it exited with 0, 0 if it
+ *  did not and -1 if it could not be run. Batches are reaped by their pid, so
+ *  nobody else takes our child, and the commands of several threads run at
+ *  the same time.
+ */
+static int exec_run(const struct exec_cmd *cmd, char **argv, const char *dir) {
+	pid_t pid;
+	int status;
+	int ret = exec_spawn(cmd, argv, dir, &pid);
+	if(ret < 0) {
+		return -1;
+	}
+	while(waitpid(pid, &status, 0) < 0) {
+		if(errno != EINTR) {
+			fprintf(stderr, "%s: cannot wait for %s: %s\n", cmd->prog, argv[0], strerror(errno));
+			return -1;
+		}
+	}
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ *  Start a batch without waiting for it, after waiting for another one if
+ *  `exec_jobs.max` are running.
+ */
+static int exec_start(const struct exec_cmd *cmd, char **argv, const char *dir) {
+	pthread_mutex_lock(&exec_jobs.lock);
+	while(exec_jobs.running >= exec_jobs.max) {
+		exec_reap();
+	}
+	pid_t pid;
+	int ret = exec_spawn(cmd, argv, dir, &pid);
+	if(ret == 0) {
+		exec_jobs.pids[exec_jobs.npids++] = pid;
+		++exec_jobs.running;
+	}
+	pthread_mutex_unlock(&exec_jobs.lock);
+	return ret;
+}
+
+/**
+ *  Return `s` with every "{}" replaced by `file`, or `s` itself if it does not
+ *  contain any.
+ */
+static char *exec_replace(char *s, const char *file) {
+	size_t n = 0;
+	for(const char *p = s; (p = strstr(p, "{}")); p += 2) {
+		++n;
+	}
+	if(n == 0) {
+		return s;
+	}
+	size_t file_len = strlen(file);
+	char *r = malloc(strlen(s) - 2 * n + file_len * n + 1);
+	if(!r) {
+		return NULL;
+	}
+	char *w = r;
+	const char *p = s;
+	for(const char *q; (q = strstr(p, "{}")); p = q + 2) {
+		memcpy(w, p, q - p);
+		w += q - p;
+		memcpy(w, file, file_len);
+		w += file_len;
+	}
+	strcpy(w, p);
+	return r;
+}
+
+/**
+ *  Run the command with "{}" replaced by `file`, for `;`.
+ */
+static int exec_one(struct exec_cmd *cmd, const char *file, const char *dir) {
+	char **argv = calloc(cmd->argc + 1, sizeof(*argv));
+	if(!argv) {
+		fprintf(stderr, "%s: %s\n", cmd->prog, strerror(errno));
+		return -1;
+	}
+	int ret = -1;
+	size_t i;
+	for(i = 0; i < cmd->argc; ++i) {
+		argv[i] = exec_replace(cmd->argv[i], file);
+		if(!argv[i]) {
+			fprintf(stderr, "%s: %s\n", cmd->prog, strerror(errno));
+			goto out;
+		}
+	}
+	ret = exec_run(cmd, argv, dir);
+out:
+	while(i-- > 0) {
+		if(argv[i] != cmd->argv[i]) {
+			free(argv[i]);
+		}
+	}
+	free(argv);
+	return ret;
+}
+
+/**
+ *  Run the pending batch, `cmd->lock` must be held.
+ */
+static int exec_flush_locked(struct exec_cmd *cmd) {
+	if(cmd->nargs == 0) {
+		return 0;
+	}
+	int ret = -1;
+	char **argv = malloc((cmd->argc + cmd->nargs + 1) * sizeof(*argv));
+	if(argv) {
+		memcpy(argv, cmd->argv, cmd->argc * sizeof(*argv));
+		char *p = cmd->args;
+		for(size_t i = 0; i < cmd->nargs; ++i) {
+			argv[cmd->argc + i] = p;
+			p += strlen(p) + 1;
+		}
+		argv[cmd->argc + cmd->nargs] = NULL;
+		ret = exec_start(cmd, argv, cmd->args_dir);
+		free(argv);
+	} else {
+		fprintf(stderr, "%s: %s\n", cmd->prog, strerror(errno));
+	}
+	// The files are dropped even if the command could not be started, they
+	// would not fare better in the next batch.
+	cmd->len = 0;
+	cmd->nargs = 0;
+	cmd->size = exec_base_size(cmd);
+	free(cmd->args_dir);
+	cmd->args_dir = NULL;
+	return ret;
+}
+
+/**
+ *  Run the pending batch of `cmd`, if any.
+ */
+int exec_flush(struct exec_cmd *cmd) {
+	pthread_mutex_lock(&cmd->lock);
+	int ret = exec_flush_locked(cmd);
+	pthread_mutex_unlock(&cmd->lock);
+	return ret;
+}
+
+/**
+ *  Append `file` to the pending batch, after running the batch if `file` does
+ *  not fit or, for `-execdir`, is in another directory than `dir`. Takes
+ *  ownership of `dir`.
+ */
+static int exec_add(struct exec_cmd *cmd, const char *file, char *dir) {
+	size_t n = strlen(file) + 1;
+	size_t size = n + sizeof(*cmd->argv);
+	int ret = 0;
+	pthread_mutex_lock(&cmd->lock);
+	if(
+		cmd->nargs > 0
+		&& (cmd->size + size > exec_jobs.limit || (dir && strcmp(dir, cmd->args_dir) != 0))
+		&& exec_flush_locked(cmd) < 0
+	) {
+		ret = -1;
+	}
+	if(cmd->len + n > cmd->cap) {
+		size_t cap = cmd->cap ? cmd->cap : 4096;
+		while(cmd->len + n > cap) {
+			cap *= 2;
+		}
+		char *args = realloc(cmd->args, cap);
+		if(!args) {
+			fprintf(stderr, "%s: %s\n", cmd->prog, strerror(errno));
+			pthread_mutex_unlock(&cmd->lock);
+			free(dir);
+			return -1;
+		}
+		cmd->args = args;
+		cmd->cap = cap;
+	}
+	memcpy(cmd->args + cmd->len, file, n);
+	cmd->len += n;
+	cmd->size += size;
+	++cmd->nargs;
+	if(dir && !cmd->args_dir) {
+		cmd->args_dir = dir;
+		dir = NULL;
+	}
+	pthread_mutex_unlock(&cmd->lock);
+	free(dir);
+	return ret;
+}
+
+/**
+ *  Run `cmd` for the file at `path`, whose name starts at `path + name`.
+ *  With `;` returns 1 if the command succeeded, 0 if it failed. With `+` the
+ *  file is added to a batch and 1 is returned, batches that fail make
+ *  `exec_wait` fail instead. Returns -1 if the command could not be run.
+ */
+int exec_file(struct exec_cmd *cmd, const char *path, size_t name) {
+	if(!cmd->dir) {
+		if(cmd->batch) {
+			return exec_add(cmd, path, NULL) < 0 ? -1 : 1;
+		}
+		return exec_one(cmd, path, NULL);
+	}
+
+	// -execdir runs in the parent directory with "./${name}", so the name
+	// cannot be mistaken for an option.
+	size_t dir_len = name;
+	while(dir_len > 1 && path[dir_len - 1] == '/') {
+		--dir_len;
+	}
+	char *dir = dir_len > 0 ? strndup(path, dir_len) : strdup(".");
+	size_t n = strlen(path + name);
+	char *file = malloc(n + 3);
+	if(!dir || !file) {
+		fprintf(stderr, "%s: %s\n", cmd->prog, strerror(errno));
+		free(dir);
+		free(file);
+		return -1;
+	}
+	memcpy(file, "./", 2);
+	memcpy(file + 2, path + name, n + 1);
+	int ret;
+	if(cmd->batch) {
+		ret = exec_add(cmd, file, dir) < 0 ? -1 : 1;
+	} else {
+		ret = exec_one(cmd, file, dir);
+		free(dir);
+	}
+	free(file);
+	return ret;
+}
+
+/**
+ *  Wait for all batches, fails if any of them did.
+ */
+int exec_wait(void) {
+	pthread_mutex_lock(&exec_jobs.lock);
+	while(exec_jobs.running > 0) {
+		exec_reap();
+	}
+	int failed = exec_jobs.failed;
+	pthread_mutex_unlock(&exec_jobs.lock);
+	return failed ? -1 : 0;
+}
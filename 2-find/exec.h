@@ -0,0 +1,49 @@
+#ifndef EXEC_H
+#define EXEC_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+/**
+ *  A command run by `-exec` or `-execdir`, created by `expr_parse`.
+ *
+ *  `argv`        the command line up to `;`, or up to `{} +` for `batch`
+ *  `batch`       for `{} +`, files are collected and the command is run with
+ *                as many as fit into `ARG_MAX`, see `exec_file`
+ *  `dir`         for `-execdir`, the command runs in the directory of the
+ *                file and gets "./${name}" instead of the path
+ *  `prog`        prefix of error messages
+ *
+ *  The pending batch is protected by `lock`, because every thread adds to it:
+ *  `args` are the null-terminated arguments, `nargs` of them in `len` bytes,
+ *  `size` is what they count against the limit and `args_dir` is the
+ *  directory they are in for `-execdir`.
+ */
+struct exec_cmd {
+	char **argv;
+	size_t argc;
+	int batch;
+	int dir;
+	const char *prog;
+	pthread_mutex_t lock;
+	char *args;
+	size_t len;
+	size_t cap;
+	size_t nargs;
+	size_t size;
+	char *args_dir;
+};
+
+int exec_init(size_t jobs);
+
+struct exec_cmd *exec_new(char **argv, size_t argc, int batch, int dir, const char *prog);
+
+void exec_free(struct exec_cmd *cmd);
+
+int exec_file(struct exec_cmd *cmd, const char *path, size_t name);
+
+int exec_flush(struct exec_cmd *cmd);
+
+int exec_wait(void);
+
+#endif
@@ -0,0 +1,646 @@
+#define _XOPEN_SOURCE 700  // S_IF*, st_mtim
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "expr.h"
+
+/**
+ *  Cost estimates, see `struct expr`. Everything that needs stat(2) is an
+ *  order of magnitude more expensive than what we know from the directory
+ *  entry.
+ */
+#define EXPR_COST_TYPE 1
+#define EXPR_COST_NAME 2
+#define EXPR_COST_FNMATCH 8
+#define EXPR_COST_STAT 100
+#define EXPR_COST_PRINT 20
+#define EXPR_COST_DELETE 100
+#define EXPR_COST_GREP 500
+#define EXPR_COST_EXEC 1000
+
+struct expr_parser {
+	char **tokens;
+	size_t n;
+	size_t pos;
+	const char *prog;
+	struct timespec now;
+};
+
+static struct expr *expr_new(struct expr_parser *p, enum expr_kind kind, unsigned cost, int pure) {
+	struct expr *e = calloc(1, sizeof(*e));
+	if(!e) {
+		fprintf(stderr, "%s: %s\n", p->prog, strerror(errno));
+		return NULL;
+	}
+	e->kind = kind;
+	e->cost = cost;
+	e->pure = pure;
+	return e;
+}
+
+void expr_free(struct expr *e) {
+	if(!e) {
+		return;
+	}
+	for(size_t i = 0; i < e->nchildren; ++i) {
+		expr_free(e->children[i]);
+	}
+	free(e->children);
+	if(e->kind == EXPR_NAME) {
+		name_match_free(&e->name);
+	} else if(e->kind == EXPR_EXEC) {
+		exec_free(e->exec);
+	} else if(e->kind == EXPR_PRINTF) {
+		format_free(&e->format);
+	}
+	free(e);
+}
+
+static int expr_add_child(struct expr_parser *p, struct expr *e, struct expr *child) {
+	struct expr **children = realloc(e->children, (e->nchildren + 1) * sizeof(*children));
+	if(!children) {
+		fprintf(stderr, "%s: %s\n", p->prog, strerror(errno));
+		return -1;
+	}
+	e->children = children;
+	e->children[e->nchildren++] = child;
+	e->cost += child->cost;
+	e->pure = e->pure && child->pure;
+	return 0;
+}
+
+/**
+ *  Sort runs of pure children by cost, so that `EXPR_AND` fails and `EXPR_OR`
+ *  succeeds as cheaply as possible. Children with side effects stay where they
+ *  are and nothing is moved across them. Insertion sort keeps equally
+ *  expensive children in command line order.
+ */
+static void expr_reorder(struct expr *e) {
+	size_t start = 0;
+	while(start < e->nchildren) {
+		size_t end = start;
+		while(end < e->nchildren && e->children[end]->pure) {
+			++end;
+		}
+		for(size_t i = start + 1; i < end; ++i) {
+			struct expr *c = e->children[i];
+			size_t j = i;
+			while(j > start && e->children[j - 1]->cost > c->cost) {
+				e->children[j] = e->children[j - 1];
+				--j;
+			}
+			e->children[j] = c;
+		}
+		start = end + 1;
+	}
+}
+
+static int expr_token_is(const struct expr_parser *p, const char *a, const char *b) {
+	return p->pos < p->n && (strcmp(p->tokens[p->pos], a) == 0 || (b && strcmp(p->tokens[p->pos], b) == 0));
+}
+
+/**
+ *  Parse `[+-]N`, `N` followed by one of `suffixes` if it is not `NULL`.
+ */
+static int expr_parse_number(const char *s, int *cmp, int64_t *n, const char *suffixes, char *suffix) {
+	*cmp = 0;
+	if(*s == '+' || *s == '-') {
+		*cmp = *s == '+' ? 1 : -1;
+		++s;
+	}
+	if(*s < '0' || *s > '9') {
+		return -1;
+	}
+	char *end;
+	errno = 0;
+	unsigned long long v = strtoull(s, &end, 10);
+	if(errno || v > INT64_MAX) {
+		return -1;
+	}
+	*n = v;
+	*suffix = '\0';
+	if(suffixes && *end && strchr(suffixes, *end)) {
+		*suffix = *end++;
+	}
+	return *end == '\0' ? 0 : -1;
+}
+
+/**
+ *  Return the position of the `;` or `+` that ends the command in `tokens`
+ *  after `-exec`, or `n` if it does not end. `+` only ends it after `{}`,
+ *  `batch` is set then.
+ */
+static size_t expr_exec_end(char **tokens, size_t n, int *batch) {
+	*batch = 0;
+	for(size_t i = 0; i < n; ++i) {
+		if(strcmp(tokens[i], ";") == 0) {
+			return i;
+		}
+		if(strcmp(tokens[i], "+") == 0 && i > 0 && strcmp(tokens[i - 1], "{}") == 0) {
+			*batch = 1;
+			return i;
+		}
+	}
+	return n;
+}
+
+/**
+ *  Return how many of the `n` `tokens` belong to the expression token
+ *  `tokens[0]` (1 plus its arguments), or 0 if it is not part of an
+ *  expression. This lets the caller collect the expression from a command
+ *  line that also has options and paths.
+ */
+size_t expr_token(char **tokens, size_t n) {
+	static const char *const plain[] = {
+		"(", ")", "!", "-not", "-a", "-and", "-o", "-or",
+		"-true", "-false", "-prune", "-print", "-print0", "-delete",
+	};
+	static const char *const with_arg[] = {
+		"-name", "-type", "-size", "-mtime", "-newer", "-grep", "-printf",
+	};
+	const char *tok = tokens[0];
+	for(size_t i = 0; i < sizeof(plain) / sizeof(*plain); ++i) {
+		if(strcmp(tok, plain[i]) == 0) {
+			return 1;
+		}
+	}
+	for(size_t i = 0; i < sizeof(with_arg) / sizeof(*with_arg); ++i) {
+		if(strcmp(tok, with_arg[i]) == 0) {
+			return n < 2 ? n : 2;
+		}
+	}
+	if(strcmp(tok, "-exec") == 0 || strcmp(tok, "-execdir") == 0) {
+		int batch;
+		size_t end = expr_exec_end(tokens + 1, n - 1, &batch);
+		return end < n - 1 ? end + 2 : n;
+	}
+	return 0;
+}
+
+/**
+ *  Parse the command of `-exec` or `-execdir` (`tok`) up to `;`, or `{} +`
+ *  for batches.
+ */
+static struct expr *expr_parse_exec(struct expr_parser *p, const char *tok) {
+	int batch;
+	size_t end = p->pos + expr_exec_end(p->tokens + p->pos, p->n - p->pos, &batch);
+	if(end >= p->n) {
+		fprintf(stderr, "%s: missing ';' or '{} +' after %s\n", p->prog, tok);
+		return NULL;
+	}
+	size_t argc = end - p->pos - (batch ? 1 : 0);
+	if(argc == 0) {
+		fprintf(stderr, "%s: missing command after %s\n", p->prog, tok);
+		return NULL;
+	}
+	struct expr *e = expr_new(p, EXPR_EXEC, EXPR_COST_EXEC, 0);
+	if(!e) {
+		return NULL;
+	}
+	e->exec = exec_new(p->tokens + p->pos, argc, batch, strcmp(tok, "-execdir") == 0, p->prog);
+	if(!e->exec) {
+		fprintf(stderr, "%s: %s\n", p->prog, strerror(errno));
+		free(e);
+		return NULL;
+	}
+	p->pos = end + 1;
+	return e;
+}
+
+static struct expr *expr_parse_or(struct expr_parser *p);
+
+static struct expr *expr_parse_primary(struct expr_parser *p) {
+	if(p->pos >= p->n) {
+		fprintf(stderr, "%s: expected an expression at the end\n", p->prog);
+		return NULL;
+	}
+	const char *tok = p->tokens[p->pos++];
+	if(strcmp(tok, "(") == 0) {
+		struct expr *e = expr_parse_or(p);
+		if(!e) {
+			return NULL;
+		}
+		if(!expr_token_is(p, ")", NULL)) {
+			fprintf(stderr, "%s: missing ')'\n", p->prog);
+			expr_free(e);
+			return NULL;
+		}
+		++p->pos;
+		return e;
+	} else if(strcmp(tok, "-true") == 0) {
+		return expr_new(p, EXPR_TRUE, 0, 1);
+	} else if(strcmp(tok, "-false") == 0) {
+		return expr_new(p, EXPR_FALSE, 0, 1);
+	} else if(strcmp(tok, "-prune") == 0) {
+		return expr_new(p, EXPR_PRUNE, 0, 0);
+	} else if(strcmp(tok, "-print") == 0 || strcmp(tok, "-print0") == 0) {
+		struct expr *e = expr_new(p, EXPR_PRINT, EXPR_COST_PRINT, 0);
+		if(e) {
+			e->terminator = strcmp(tok, "-print0") == 0 ? '\0' : '\n';
+		}
+		return e;
+	} else if(strcmp(tok, "-delete") == 0) {
+		return expr_new(p, EXPR_DELETE, EXPR_COST_DELETE, 0);
+	} else if(strcmp(tok, "-exec") == 0 || strcmp(tok, "-execdir") == 0) {
+		return expr_parse_exec(p, tok);
+	}
+
+	// tests with an argument
+	if(expr_token(&p->tokens[p->pos - 1], p->n - p->pos + 1) != 2) {
+		fprintf(stderr, "%s: unexpected %s\n", p->prog, tok);
+		return NULL;
+	}
+	if(p->pos >= p->n) {
+		fprintf(stderr, "%s: missing argument after %s\n", p->prog, tok);
+		return NULL;
+	}
+	const char *arg = p->tokens[p->pos++];
+	struct expr *e = NULL;
+	char suffix;
+	if(strcmp(tok, "-name") == 0) {
+		e = expr_new(p, EXPR_NAME, EXPR_COST_NAME, 1);
+		// Compile the pattern once instead of interpreting it for every file.
+		if(e && name_match_compile(&e->name, arg) < 0) {
+			fprintf(stderr, "%s: %s\n", p->prog, strerror(errno));
+			free(e);
+			return NULL;
+		}
+		if(e && e->name.kind == NAME_MATCH_FNMATCH) {
+			e->cost = EXPR_COST_FNMATCH;
+		}
+	} else if(strcmp(tok, "-type") == 0) {
+		static const char letters[] = "dflbcps";
+		static const mode_t types[] = {S_IFDIR, S_IFREG, S_IFLNK, S_IFBLK, S_IFCHR, S_IFIFO, S_IFSOCK};
+		const char *l = arg[0] != '\0' && arg[1] == '\0' ? strchr(letters, arg[0]) : NULL;
+		if(!l) {
+			fprintf(stderr, "%s: unsupported -type: %s\n", p->prog, arg);
+			return NULL;
+		}
+		e = expr_new(p, EXPR_TYPE, EXPR_COST_TYPE, 1);
+		if(e) {
+			e->type = types[l - letters];
+		}
+	} else if(strcmp(tok, "-size") == 0) {
+		e = expr_new(p, EXPR_SIZE, EXPR_COST_STAT, 1);
+		if(e && expr_parse_number(arg, &e->cmp, &e->n, "bcwkMG", &suffix) < 0) {
+			fprintf(stderr, "%s: invalid -size: %s\n", p->prog, arg);
+			free(e);
+			return NULL;
+		}
+		if(e) {
+			switch(suffix) {
+			case 'c':
+				e->unit = 1;
+				break;
+			case 'w':
+				e->unit = 2;
+				break;
+			case 'k':
+				e->unit = 1024;
+				break;
+			case 'M':
+				e->unit = 1024 * 1024;
+				break;
+			case 'G':
+				e->unit = 1024 * 1024 * 1024;
+				break;
+			default:
+				e->unit = 512;
+				break;
+			}
+		}
+	} else if(strcmp(tok, "-mtime") == 0) {
+		e = expr_new(p, EXPR_MTIME, EXPR_COST_STAT, 1);
+		if(e && expr_parse_number(arg, &e->cmp, &e->n, NULL, &suffix) < 0) {
+			fprintf(stderr, "%s: invalid -mtime: %s\n", p->prog, arg);
+			free(e);
+			return NULL;
+		}
+		if(e) {
+			e->time = p->now;
+		}
+	} else if(strcmp(tok, "-grep") == 0) {
+		// Reading files is the most expensive test, so it comes last.
+		e = expr_new(p, EXPR_GREP, EXPR_COST_GREP, 1);
+		if(e) {
+			grep_init(&e->grep, arg);
+		}
+	} else if(strcmp(tok, "-printf") == 0) {
+		// Compile the format once instead of interpreting it for every file.
+		e = expr_new(p, EXPR_PRINTF, EXPR_COST_PRINT, 0);
+		if(e && format_compile(&e->format, arg, p->prog) < 0) {
+			free(e);
+			return NULL;
+		}
+	} else {
+		struct stat st;
+		if(stat(arg, &st) < 0) {
+			fprintf(stderr, "%s: cannot stat %s: %s\n", p->prog, arg, strerror(errno));
+			return NULL;
+		}
+		e = expr_new(p, EXPR_NEWER, EXPR_COST_STAT, 1);
+		if(e) {
+			e->time = st.st_mtim;
+		}
+	}
+	return e;
+}
+
+static struct expr *expr_parse_not(struct expr_parser *p) {
+	if(expr_token_is(p, "!", "-not")) {
+		++p->pos;
+		struct expr *child = expr_parse_not(p);
+		if(!child) {
+			return NULL;
+		}
+		struct expr *e = expr_new(p, EXPR_NOT, 0, 1);
+		if(!e || expr_add_child(p, e, child) < 0) {
+			expr_free(e);
+			expr_free(child);
+			return NULL;
+		}
+		return e;
+	}
+	return expr_parse_primary(p);
+}
+
+/**
+ *  Parse a list of operands separated by `op1` or `op2` (the binary operators
+ *  of `kind`), or by nothing for `EXPR_AND`. Nested lists of the same kind
+ *  are flattened, so their children can be reordered together.
+ */
+static struct expr *expr_parse_list(
+	struct expr_parser *p,
+	enum expr_kind kind,
+	const char *op1,
+	const char *op2,
+	struct expr *(*operand)(struct expr_parser *p)
+) {
+	struct expr *first = operand(p);
+	if(!first) {
+		return NULL;
+	}
+	struct expr *e = NULL;
+	while(p->pos < p->n) {
+		if(expr_token_is(p, op1, op2)) {
+			++p->pos;
+		} else if(kind != EXPR_AND || expr_token_is(p, "-o", "-or") || expr_token_is(p, ")", NULL)) {
+			break;
+		}
+		if(!e) {
+			e = expr_new(p, kind, 0, 1);
+			if(!e || expr_add_child(p, e, first) < 0) {
+				expr_free(e);
+				expr_free(first);
+				return NULL;
+			}
+		}
+		struct expr *next = operand(p);
+		if(!next) {
+			expr_free(e);
+			return NULL;
+		}
+		if(next->kind == kind) {
+			for(size_t i = 0; i < next->nchildren; ++i) {
+				if(expr_add_child(p, e, next->children[i]) < 0) {
+					// the children not moved yet are freed with `next`
+					expr_free(next);
+					expr_free(e);
+					return NULL;
+				}
+				next->children[i] = NULL;
+			}
+			next->nchildren = 0;
+			expr_free(next);
+		} else if(expr_add_child(p, e, next) < 0) {
+			expr_free(next);
+			expr_free(e);
+			return NULL;
+		}
+	}
+	if(!e) {
+		return first;
+	}
+	expr_reorder(e);
+	return e;
+}
+
+static struct expr *expr_parse_and(struct expr_parser *p) {
+	return expr_parse_list(p, EXPR_AND, "-a", "-and", expr_parse_not);
+}
+
+static struct expr *expr_parse_or(struct expr_parser *p) {
+	return expr_parse_list(p, EXPR_OR, "-o", "-or", expr_parse_and);
+}
+
+static int expr_has_action(const struct expr *e) {
+	if(e->kind == EXPR_PRINT || e->kind == EXPR_PRINTF || e->kind == EXPR_EXEC || e->kind == EXPR_DELETE) {
+		return 1;
+	}
+	for(size_t i = 0; i < e->nchildren; ++i) {
+		if(expr_has_action(e->children[i])) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ *  Parse the expression `tokens`. Like find(1), `-print` is appended if there
+ *  is no action (`-print`, `-print0`, `-printf`, `-exec` or `-delete`), and
+ *  an empty expression prints everything. `tokens` are borrowed by `-exec`.
+ *  Errors are reported with the prefix `prog`, `NULL` is returned then.
+ */
+struct expr *expr_parse(char **tokens, size_t n, const char *prog) {
+	struct expr_parser p = {
+		.tokens = tokens,
+		.n = n,
+		.pos = 0,
+		.prog = prog,
+	};
+	clock_gettime(CLOCK_REALTIME, &p.now);
+
+	struct expr *print = expr_new(&p, EXPR_PRINT, EXPR_COST_PRINT, 0);
+	if(!print) {
+		return NULL;
+	}
+	print->terminator = '\n';
+	if(n == 0) {
+		return print;
+	}
+
+	struct expr *e = expr_parse_or(&p);
+	if(e && p.pos < p.n) {
+		fprintf(stderr, "%s: unexpected %s\n", prog, tokens[p.pos]);
+		expr_free(e);
+		e = NULL;
+	}
+	if(!e || expr_has_action(e)) {
+		expr_free(print);
+		return e;
+	}
+	// ( expr ) -a -print
+	struct expr *and = expr_new(&p, EXPR_AND, 0, 1);
+	if(!and || expr_add_child(&p, and, e) < 0) {
+		expr_free(and);
+		expr_free(e);
+		expr_free(print);
+		return NULL;
+	}
+	if(expr_add_child(&p, and, print) < 0) {
+		expr_free(and);
+		expr_free(print);
+		return NULL;
+	}
+	return and;
+}
+
+/**
+ *  Compare `v` to `n` the way `cmp` says, see `struct expr`.
+ */
+static int expr_cmp(int cmp, int64_t v, int64_t n) {
+	return cmp < 0 ? v < n : cmp > 0 ? v > n : v == n;
+}
+
+/**
+ *  Evaluate `e` for `f`. Returns 1 if it is true, 0 if it is false and -1 if
+ *  an action failed, evaluation stops then.
+ */
+int expr_eval(const struct expr *e, struct expr_file *f) {
+	const struct stat *st;
+	int ret;
+	switch(e->kind) {
+	case EXPR_AND:
+		for(size_t i = 0; i < e->nchildren; ++i) {
+			if((ret = expr_eval(e->children[i], f)) <= 0) {
+				return ret;
+			}
+		}
+		return 1;
+	case EXPR_OR:
+		for(size_t i = 0; i < e->nchildren; ++i) {
+			if((ret = expr_eval(e->children[i], f)) != 0) {
+				return ret;
+			}
+		}
+		return 0;
+	case EXPR_NOT:
+		ret = expr_eval(e->children[0], f);
+		return ret < 0 ? ret : !ret;
+	case EXPR_TRUE:
+		return 1;
+	case EXPR_FALSE:
+		return 0;
+	case EXPR_NAME:
+		if(f->root) {
+			return name_match_slash(&e->name, f->name) == 0;
+		}
+		return name_match(&e->name, f->name, f->name_len) == 0;
+	case EXPR_TYPE:
+		return (f->mode & S_IFMT) == e->type;
+	case EXPR_SIZE:
+		if(!(st = f->stat(f->ctx))) {
+			return 0;
+		}
+		return expr_cmp(e->cmp, (st->st_size + e->unit - 1) / e->unit, e->n);
+	case EXPR_MTIME:
+		if(!(st = f->stat(f->ctx))) {
+			return 0;
+		} else {
+			int64_t age = (int64_t)e->time.tv_sec - st->st_mtim.tv_sec;
+			// round towards minus infinity for files from the future
+			int64_t days = age >= 0 ? age / 86400 : -((-age + 86399) / 86400);
+			return expr_cmp(e->cmp, days, e->n);
+		}
+	case EXPR_NEWER:
+		if(!(st = f->stat(f->ctx))) {
+			return 0;
+		}
+		return st->st_mtim.tv_sec > e->time.tv_sec
+			|| (st->st_mtim.tv_sec == e->time.tv_sec && st->st_mtim.tv_nsec > e->time.tv_nsec);
+	case EXPR_GREP:
+		if((f->mode & S_IFMT) != S_IFREG) {
+			return 0;
+		}
+		return f->grep(f->ctx, &e->grep) > 0;
+	case EXPR_PRUNE:
+		f->prune = 1;
+		return 1;
+	case EXPR_PRINT:
+		return f->print(f->ctx, e->terminator) < 0 ? -1 : 1;
+	case EXPR_PRINTF:
+		return f->format(f->ctx, &e->format) < 0 ? -1 : 1;
+	case EXPR_EXEC:
+		return f->exec(f->ctx, e->exec);
+	case EXPR_DELETE:
+		return f->delete(f->ctx) < 0 ? -1 : 1;
+	}
+	return 0;
+}
+
+/**
+ *  Run the pending batches of all `-exec ... {} +` in `e`, see `exec_flush`.
+ */
+int expr_flush(const struct expr *e) {
+	int ret = 0;
+	if(e->kind == EXPR_EXEC && exec_flush(e->exec) < 0) {
+		ret = -1;
+	}
+	for(size_t i = 0; i < e->nchildren; ++i) {
+		if(expr_flush(e->children[i]) < 0) {
+			ret = -1;
+		}
+	}
+	return ret;
+}
+
+/**
+ *  Which fields of `struct stat` evaluating `e` may need, `EXPR_STAT_*`. If it
+ *  is 0, `stat` of `struct expr_file` is never called.
+ */
+unsigned expr_stat_fields(const struct expr *e) {
+	unsigned fields = 0;
+	if(e->kind == EXPR_SIZE || e->kind == EXPR_GREP) {
+		fields |= EXPR_STAT_SIZE;
+	} else if(e->kind == EXPR_MTIME || e->kind == EXPR_NEWER) {
+		fields |= EXPR_STAT_MTIME;
+	} else if(e->kind == EXPR_PRINTF) {
+		for(size_t i = 0; i < e->format.nops; ++i) {
+			switch(e->format.ops[i].kind) {
+			case FORMAT_SIZE:
+				fields |= EXPR_STAT_SIZE;
+				break;
+			case FORMAT_MTIME:
+				fields |= EXPR_STAT_MTIME;
+				break;
+			case FORMAT_INODE:
+				fields |= EXPR_STAT_INO;
+				break;
+			default:
+				break;
+			}
+		}
+	}
+	for(size_t i = 0; i < e->nchildren; ++i) {
+		fields |= expr_stat_fields(e->children[i]);
+	}
+	return fields;
+}
+
+/**
+ *  Whether `e` contains `-delete`, which has to visit directories after their
+ *  entries.
+ */
+int expr_has_delete(const struct expr *e) {
+	if(e->kind == EXPR_DELETE) {
+		return 1;
+	}
+	for(size_t i = 0; i < e->nchildren; ++i) {
+		if(expr_has_delete(e->children[i])) {
+			return 1;
+		}
+	}
+	return 0;
+}
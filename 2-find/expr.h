@@ -0,0 +1,121 @@
+#ifndef EXPR_H
+#define EXPR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "exec.h"
+#include "format.h"
+#include "grep.h"
+#include "name-match.h"
+
+/**
+ *  A find(1) expression parsed by `expr_parse`. `EXPR_AND` and `EXPR_OR` have
+ *  any number of `children`, `EXPR_NOT` has one.
+ *
+ *  `cost` estimates how expensive it is to evaluate the node, tests that need
+ *  stat(2) are much more expensive than the ones that only need the name or
+ *  file type. `pure` is 0 if evaluating the node has side effects (actions and
+ *  `-prune`), so it must not be moved.
+ *
+ *  `EXPR_NAME`   `name`
+ *  `EXPR_TYPE`   `type` is compared to `st_mode & S_IFMT`
+ *  `EXPR_SIZE`   `st_size` rounded up to `unit`s compared to `n`, `cmp` is -1
+ *                for `-N`, 0 for `N` and 1 for `+N`
+ *  `EXPR_MTIME`  whole days between `time` (when we started) and `st_mtim`
+ *                compared to `n`, `cmp` like for `EXPR_SIZE`
+ *  `EXPR_NEWER`  `st_mtim` is after `time`
+ *  `EXPR_GREP`   a regular file that contains `grep`
+ *  `EXPR_PRINT`  print the path followed by `terminator`
+ *  `EXPR_PRINTF` print `format`
+ *  `EXPR_EXEC`   run `exec`, see `struct exec_cmd`
+ *  `EXPR_DELETE` remove the file
+ */
+struct expr {
+	enum expr_kind {
+		EXPR_AND,
+		EXPR_OR,
+		EXPR_NOT,
+		EXPR_TRUE,
+		EXPR_FALSE,
+		EXPR_NAME,
+		EXPR_TYPE,
+		EXPR_SIZE,
+		EXPR_MTIME,
+		EXPR_NEWER,
+		EXPR_GREP,
+		EXPR_PRUNE,
+		EXPR_PRINT,
+		EXPR_PRINTF,
+		EXPR_EXEC,
+		EXPR_DELETE,
+	} kind;
+	unsigned cost;
+	int pure;
+	struct expr **children;
+	size_t nchildren;
+	struct name_match name;
+	mode_t type;
+	int cmp;
+	int64_t n;
+	int64_t unit;
+	struct timespec time;
+	struct grep grep;
+	char terminator;
+	struct format format;
+	struct exec_cmd *exec;
+};
+
+/**
+ *  The file an expression is evaluated for, filled in by the caller.
+ *  `name`      the file's name, `name_len` bytes long
+ *  `root`      set for paths given on the command line, their `name` is
+ *              null-terminated and may contain '/'
+ *  `mode`      the file type, which is always known
+ *  `stat`      called by tests that need more than the file type, returns
+ *              `NULL` if the file cannot be stat(2)ed after reporting it, may
+ *              be `NULL` if `expr_stat_fields` is 0
+ *  `print`     called by `-print`, returns -1 after reporting an error
+ *  `format`    called by `-printf`, returns -1 after reporting an error
+ *  `exec`      called by `-exec`, returns what `exec_file` does
+ *  `grep`      called by `-grep` for regular files, returns what `grep_fd`
+ *              does for the file, after reporting errors
+ *  `delete`    called by `-delete`, returns -1 after reporting an error
+ *  `prune`     set by `-prune`
+ */
+struct expr_file {
+	const char *name;
+	size_t name_len;
+	int root;
+	mode_t mode;
+	const struct stat *(*stat)(void *ctx);
+	int (*print)(void *ctx, char terminator);
+	int (*format)(void *ctx, const struct format *fmt);
+	int (*exec)(void *ctx, struct exec_cmd *cmd);
+	int (*grep)(void *ctx, const struct grep *g);
+	int (*delete)(void *ctx);
+	void *ctx;
+	int prune;
+};
+
+size_t expr_token(char **tokens, size_t n);
+
+struct expr *expr_parse(char **tokens, size_t n, const char *prog);
+
+void expr_free(struct expr *e);
+
+int expr_eval(const struct expr *e, struct expr_file *f);
+
+int expr_flush(const struct expr *e);
+
+#define EXPR_STAT_SIZE 1
+#define EXPR_STAT_MTIME 2
+#define EXPR_STAT_INO 4
+
+unsigned expr_stat_fields(const struct expr *e);
+
+int expr_has_delete(const struct expr *e);
+
+#endif
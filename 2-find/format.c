@@ -0,0 +1,240 @@
+#define _XOPEN_SOURCE 700  // S_IF*, st_mtim
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "format.h"
+
+static void format_literal(struct format *f, size_t *lits_len, char c) {
+	struct format_op *last = f->nops > 0 ? &f->ops[f->nops - 1] : NULL;
+	if(!last || last->kind != FORMAT_LITERAL) {
+		last = &f->ops[f->nops++];
+		*last = (struct format_op){
+			.kind = FORMAT_LITERAL,
+			.start = *lits_len,
+			.len = 0,
+		};
+	}
+	f->lits[(*lits_len)++] = c;
+	++last->len;
+}
+
+/**
+ *  Compile the `-printf` format `s`. Besides the directives of
+ *  `struct format`, `%%` is a '%', and the escapes `\n`, `\t`, `\r`, `\0` and
+ *  `\\` are resolved. Unknown directives and escapes are reported with the
+ *  prefix `prog`, -1 is returned then.
+ */
+int format_compile(struct format *f, const char *s, const char *prog) {
+	size_t n = strlen(s);
+	*f = (struct format){
+		// every op takes at least one character
+		.ops = malloc((n ? n : 1) * sizeof(*f->ops)),
+		.nops = 0,
+		.lits = malloc(n ? n : 1),
+		.stat = 0,
+	};
+	if(!f->ops || !f->lits) {
+		fprintf(stderr, "%s: %s\n", prog, strerror(errno));
+		format_free(f);
+		return -1;
+	}
+	size_t lits_len = 0;
+	for(const char *p = s; *p; ++p) {
+		if(*p == '\\') {
+			char c;
+			switch(*++p) {
+			case 'n':
+				c = '\n';
+				break;
+			case 't':
+				c = '\t';
+				break;
+			case 'r':
+				c = '\r';
+				break;
+			case '0':
+				c = '\0';
+				break;
+			case '\\':
+				c = '\\';
+				break;
+			default:
+				fprintf(stderr, "%s: -printf: unknown escape \\%.1s\n", prog, p);
+				format_free(f);
+				return -1;
+			}
+			format_literal(f, &lits_len, c);
+			continue;
+		} else if(*p != '%') {
+			format_literal(f, &lits_len, *p);
+			continue;
+		}
+
+		int kind;
+		switch(*++p) {
+		case '%':
+			format_literal(f, &lits_len, '%');
+			continue;
+		case 'p':
+			kind = FORMAT_PATH;
+			break;
+		case 'f':
+			kind = FORMAT_NAME;
+			break;
+		case 's':
+			kind = FORMAT_SIZE;
+			break;
+		case 'y':
+			kind = FORMAT_TYPE;
+			break;
+		case 'i':
+			kind = FORMAT_INODE;
+			break;
+		case 'd':
+			kind = FORMAT_DEPTH;
+			break;
+		case 'T':
+			if(p[1] == '@') {
+				kind = FORMAT_MTIME;
+				++p;
+				break;
+			}
+			// fall through
+		default:
+			fprintf(stderr, "%s: -printf: unknown directive %%%.2s\n", prog, p);
+			format_free(f);
+			return -1;
+		}
+		f->ops[f->nops++] = (struct format_op){.kind = kind};
+		if(kind == FORMAT_SIZE || kind == FORMAT_MTIME || kind == FORMAT_INODE) {
+			f->stat = 1;
+		}
+	}
+	return 0;
+}
+
+void format_free(struct format *f) {
+	free(f->ops);
+	free(f->lits);
+	*f = (struct format){0};
+}
+
+/**
+ *  Write `v` in decimal so that it ends before `end`, and return where it
+ *  starts.
+ */
+static char *format_u64(char *end, uint64_t v) {
+	do {
+		*--end = '0' + v % 10;
+		v /= 10;
+	} while(v);
+	return end;
+}
+
+static char format_type(mode_t mode) {
+	switch(mode & S_IFMT) {
+	case S_IFREG:
+		return 'f';
+	case S_IFDIR:
+		return 'd';
+	case S_IFLNK:
+		return 'l';
+	case S_IFBLK:
+		return 'b';
+	case S_IFCHR:
+		return 'c';
+	case S_IFIFO:
+		return 'p';
+	case S_IFSOCK:
+		return 's';
+	default:
+		return 'U';
+	}
+}
+
+/**
+ *  `%T@` like find(1): seconds, a '.' and 10 digits of fraction, of which
+ *  only the first 9 can be known. Returns where it starts before `end`.
+ */
+static char *format_mtime(char *end, const struct timespec *ts) {
+	int64_t sec = ts->tv_sec;
+	long nsec = ts->tv_nsec;
+	int negative = sec < 0;
+	if(negative) {
+		sec = -sec;
+		if(nsec > 0) {
+			--sec;
+			nsec = 1000000000 - nsec;
+		}
+	}
+	char *p = end;
+	*--p = '0';
+	for(int i = 0; i < 9; ++i) {
+		*--p = '0' + nsec % 10;
+		nsec /= 10;
+	}
+	*--p = '.';
+	p = format_u64(p, sec);
+	if(negative) {
+		*--p = '-';
+	}
+	return p;
+}
+
+/**
+ *  Write the record of `file` to `o`. Returns -1 if writing fails.
+ */
+int format_write(const struct format *f, struct output *o, const struct format_file *file) {
+	// enough for any 64 bit number, and for `%T@`
+	char buf[32];
+	char *end = buf + sizeof(buf);
+	for(size_t i = 0; i < f->nops; ++i) {
+		const struct format_op *op = &f->ops[i];
+		const char *s = end;
+		switch(op->kind) {
+		case FORMAT_LITERAL:
+			if(output_add(o, f->lits + op->start, op->len) < 0) {
+				return -1;
+			}
+			continue;
+		case FORMAT_PATH:
+			if(output_add(o, file->path, file->path_len) < 0) {
+				return -1;
+			}
+			continue;
+		case FORMAT_NAME:
+			// the root "/" has no last component, it is its own name
+			s = file->path;
+			if(file->name < file->path_len) {
+				s += file->name;
+			}
+			if(output_add(o, s, file->path + file->path_len - s) < 0) {
+				return -1;
+			}
+			continue;
+		case FORMAT_SIZE:
+			s = format_u64(end, file->st->st_size);
+			break;
+		case FORMAT_MTIME:
+			s = format_mtime(end, &file->st->st_mtim);
+			break;
+		case FORMAT_TYPE:
+			s = end - 1;
+			*(end - 1) = format_type(file->mode);
+			break;
+		case FORMAT_INODE:
+			s = format_u64(end, file->st->st_ino);
+			break;
+		case FORMAT_DEPTH:
+			s = format_u64(end, file->depth);
+			break;
+		}
+		if(output_add(o, s, end - s) < 0) {
+			return -1;
+		}
+	}
+	return output_end(o);
+}
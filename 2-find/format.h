@@ -0,0 +1,67 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stddef.h>
+#include <sys/stat.h>
+
+#include "output.h"
+
+/**
+ *  A `-printf` format compiled once by `format_compile` into a list of `ops`,
+ *  so printing a file does not parse it again.
+ *
+ *  `FORMAT_LITERAL` `len` bytes of `lits` at `start`, with escapes resolved
+ *  `FORMAT_PATH`    `%p` the path
+ *  `FORMAT_NAME`    `%f` the name, the last component of the path
+ *  `FORMAT_SIZE`    `%s` `st_size`
+ *  `FORMAT_MTIME`   `%T@` `st_mtim` in seconds since the epoch, with fraction
+ *  `FORMAT_TYPE`    `%y` the file type as a letter like `-type` takes
+ *  `FORMAT_INODE`   `%i` `st_ino`
+ *  `FORMAT_DEPTH`   `%d` the depth, 0 for roots
+ *
+ *  `stat` is set if any op needs `st` of `struct format_file`.
+ */
+struct format {
+	struct format_op {
+		enum {
+			FORMAT_LITERAL,
+			FORMAT_PATH,
+			FORMAT_NAME,
+			FORMAT_SIZE,
+			FORMAT_MTIME,
+			FORMAT_TYPE,
+			FORMAT_INODE,
+			FORMAT_DEPTH,
+		} kind;
+		size_t start;
+		size_t len;
+	} *ops;
+	size_t nops;
+	char *lits;
+	int stat;
+};
+
+/**
+ *  The file a format is written for, filled in by the caller.
+ *  `path`      the path, `path_len` bytes long
+ *  `name`      offset of the last component in `path`
+ *  `depth`     0 for roots
+ *  `mode`      the file type, which is always known
+ *  `st`        the stat(2) of the file if `stat` of `struct format` is set
+ */
+struct format_file {
+	const char *path;
+	size_t path_len;
+	size_t name;
+	size_t depth;
+	mode_t mode;
+	const struct stat *st;
+};
+
+int format_compile(struct format *f, const char *s, const char *prog);
+
+void format_free(struct format *f);
+
+int format_write(const struct format *f, struct output *o, const struct format_file *file);
+
+#endif
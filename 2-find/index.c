@@ -0,0 +1,228 @@
+#define _POSIX_C_SOURCE 200809L  // mkstemp
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "index.h"
+
+/**
+ *  Map the index at `path` and check that it is consistent, so entries and
+ *  names can be used without further bounds checks. Sets `errno` to `EINVAL`
+ *  if it is not a valid index.
+ */
+int index_open(struct index *idx, const char *path) {
+	*idx = (struct index){0};
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0) {
+		return -1;
+	}
+	struct stat st;
+	if(fstat(fd, &st) < 0) {
+		goto fail_close;
+	}
+	if((size_t)st.st_size < sizeof(struct index_header)) {
+		errno = EINVAL;
+		goto fail_close;
+	}
+	idx->size = st.st_size;
+	idx->map = mmap(NULL, idx->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(idx->map == MAP_FAILED) {
+		idx->map = NULL;
+		goto fail_close;
+	}
+	close(fd);
+
+	idx->header = idx->map;
+	idx->entries = (const struct index_entry *)(idx->header + 1);
+	const struct index_header *h = idx->header;
+	if(
+		memcmp(h->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0
+		|| h->version != INDEX_VERSION
+		|| h->nentries > (idx->size - sizeof(*h)) / sizeof(struct index_entry)
+		|| h->names_size != idx->size - sizeof(*h) - h->nentries * sizeof(struct index_entry)
+	) {
+		goto invalid;
+	}
+	idx->names = (const char *)(idx->entries + h->nentries);
+	if(h->names_size > 0 && idx->names[h->names_size - 1] != '\0') {
+		goto invalid;
+	}
+	for(uint64_t i = 0; i < h->nentries; ++i) {
+		const struct index_entry *e = &idx->entries[i];
+		if(
+			e->name >= h->names_size
+			|| e->end <= i
+			|| e->end > h->nentries
+			|| (i == 0 && e->depth != 0)
+			|| (i > 0 && e->depth > idx->entries[i - 1].depth + 1)
+		) {
+			goto invalid;
+		}
+	}
+	return 0;
+
+invalid:
+	index_close(idx);
+	errno = EINVAL;
+	return -1;
+fail_close:
+	{
+		int errbak = errno;
+		close(fd);
+		errno = errbak;
+	}
+	return -1;
+}
+
+void index_close(struct index *idx) {
+	if(idx->map) {
+		munmap(idx->map, idx->size);
+	}
+	*idx = (struct index){0};
+}
+
+void index_writer_init(struct index_writer *w) {
+	*w = (struct index_writer){0};
+}
+
+void index_writer_free(struct index_writer *w) {
+	free(w->entries);
+	free(w->names);
+	index_writer_init(w);
+}
+
+/**
+ *  Append an entry and return it for the caller to fill in. The pointer is
+ *  only valid until the next call, use its index `w->nentries - 1` to update
+ *  it later.
+ */
+struct index_entry *index_writer_add(struct index_writer *w, const char *name, uint32_t depth) {
+	size_t n = strlen(name) + 1;
+	if(w->nentries >= UINT32_MAX || w->names_size + n > UINT32_MAX) {
+		errno = EOVERFLOW;
+		return NULL;
+	}
+	if(w->nentries == w->cap) {
+		size_t cap = w->cap ? w->cap * 2 : 1024;
+		struct index_entry *entries = realloc(w->entries, cap * sizeof(*entries));
+		if(!entries) {
+			return NULL;
+		}
+		w->entries = entries;
+		w->cap = cap;
+	}
+	if(w->names_size + n > w->names_cap) {
+		size_t cap = w->names_cap ? w->names_cap : 16 * 1024;
+		while(w->names_size + n > cap) {
+			cap *= 2;
+		}
+		char *names = realloc(w->names, cap);
+		if(!names) {
+			return NULL;
+		}
+		w->names = names;
+		w->names_cap = cap;
+	}
+	memcpy(w->names + w->names_size, name, n);
+	struct index_entry *e = &w->entries[w->nentries];
+	*e = (struct index_entry){
+		.name = w->names_size,
+		.end = w->nentries + 1,
+		.depth = depth,
+	};
+	w->names_size += n;
+	++w->nentries;
+	return e;
+}
+
+static int write_all(int fd, const void *data, size_t n) {
+	const char *p = data;
+	while(n > 0) {
+		ssize_t w = write(fd, p, n);
+		if(w < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		p += w;
+		n -= w;
+	}
+	return 0;
+}
+
+/**
+ *  Write the index to a temporary file next to `path` and rename it to `path`,
+ *  so readers never see a partially written index.
+ */
+int index_writer_save(
+	const struct index_writer *w,
+	const char *path,
+	uint32_t flags,
+	int64_t built_sec,
+	uint32_t built_nsec
+) {
+	struct index_header h = {
+		.version = INDEX_VERSION,
+		.flags = flags,
+		.nentries = w->nentries,
+		.names_size = w->names_size,
+		.built_sec = built_sec,
+		.built_nsec = built_nsec,
+	};
+	memcpy(h.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+
+	size_t n = strlen(path);
+	char *tmp = malloc(n + sizeof(".XXXXXX"));
+	if(!tmp) {
+		return -1;
+	}
+	memcpy(tmp, path, n);
+	memcpy(tmp + n, ".XXXXXX", sizeof(".XXXXXX"));
+	int fd = mkstemp(tmp);
+	if(fd < 0) {
+		goto fail_free;
+	}
+	// mkstemp(3) creates the file with mode 0600, use what open(2) would.
+	mode_t mask = umask(0);
+	umask(mask);
+	if(
+		write_all(fd, &h, sizeof(h)) < 0
+		|| write_all(fd, w->entries, w->nentries * sizeof(*w->entries)) < 0
+		|| write_all(fd, w->names, w->names_size) < 0
+		|| fchmod(fd, 0666 & ~mask) < 0
+	) {
+		int errbak = errno;
+		close(fd);
+		unlink(tmp);
+		errno = errbak;
+		goto fail_free;
+	}
+	if(close(fd) < 0) {
+		int errbak = errno;
+		unlink(tmp);
+		errno = errbak;
+		goto fail_free;
+	}
+	if(rename(tmp, path) < 0) {
+		int errbak = errno;
+		unlink(tmp);
+		errno = errbak;
+		goto fail_free;
+	}
+	free(tmp);
+	return 0;
+
+fail_free:
+	{
+		int errbak = errno;
+		free(tmp);
+		errno = errbak;
+	}
+	return -1;
+}
@@ -0,0 +1,105 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ *  On-disk directory index written by `find -build-index` and read by
+ *  `find -index`. The file is used in place with mmap(2):
+ *
+ *      struct index_header
+ *      struct index_entry[nentries]
+ *      char names[names_size]     null-terminated names
+ *
+ *  Entries are in pre-order, so a subtree is a contiguous range of entries:
+ *  it starts at the directory's entry and ends at its `end`. A directory's
+ *  children are `dir + 1`, then `children[0].end`, and so on until `dir.end`.
+ *  Roots have `depth == 0` and their name is the path given on the command
+ *  line.
+ *
+ *  `type` is the file type as `d_type` (of the target with `-follow`), it is
+ *  what `-type` is matched against. `d_type` is the type the directory entry
+ *  reported, it decides whether the file is stat(2)ed again when the index is
+ *  refreshed, just like in a normal traversal.
+ *
+ *  `dev`, `ino` and `mtime` are only filled in for directories, they are used
+ *  to decide whether a directory has to be read again when refreshing the
+ *  index. Other entries only have the `ino` from their directory entry.
+ */
+#define INDEX_MAGIC "FINDIDX"
+#define INDEX_VERSION 1
+
+#define INDEX_FOLLOW 1
+#define INDEX_XDEV 2
+
+struct index_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+	uint64_t nentries;
+	uint64_t names_size;
+	int64_t built_sec;
+	uint32_t built_nsec;
+	uint32_t reserved;
+};
+
+struct index_entry {
+	uint64_t ino;
+	uint64_t dev;
+	int64_t mtime_sec;
+	uint32_t mtime_nsec;
+	uint32_t name;
+	uint32_t end;
+	uint32_t depth;
+	uint8_t type;
+	uint8_t d_type;
+	uint8_t reserved[6];
+};
+
+/**
+ *  An index mapped by `index_open`.
+ */
+struct index {
+	void *map;
+	size_t size;
+	const struct index_header *header;
+	const struct index_entry *entries;
+	const char *names;
+};
+
+/**
+ *  An index being built in memory, `index_writer_save` writes it to disk.
+ */
+struct index_writer {
+	struct index_entry *entries;
+	size_t nentries;
+	size_t cap;
+	char *names;
+	size_t names_size;
+	size_t names_cap;
+};
+
+int index_open(struct index *idx, const char *path);
+
+void index_close(struct index *idx);
+
+static inline const char *index_name(const struct index *idx, const struct index_entry *e) {
+	return idx->names + e->name;
+}
+
+void index_writer_init(struct index_writer *w);
+
+void index_writer_free(struct index_writer *w);
+
+struct index_entry *index_writer_add(struct index_writer *w, const char *name, uint32_t depth);
+
+int index_writer_save(
+	const struct index_writer *w,
+	const char *path,
+	uint32_t flags,
+	int64_t built_sec,
+	uint32_t built_nsec
+);
+
+#endif
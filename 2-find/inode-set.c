@@ -0,0 +1,207 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "inode-set.h"
+
+void inode_set_init(struct inode_set *s) {
+	*s = (struct inode_set){
+		.slots = NULL,
+		.mask = 0,
+		.len = 0,
+	};
+}
+
+void inode_set_free(struct inode_set *s) {
+	free(s->slots);
+	inode_set_init(s);
+}
+
+/**
+ *  Inode numbers are often sequential, so mix the bits (splitmix64 finalizer)
+ *  to spread them over the table.
+ */
+static size_t inode_hash(dev_t dev, ino_t ino) {
+	uint64_t h = (uint64_t)ino ^ ((uint64_t)dev * UINT64_C(0x9e3779b97f4a7c15));
+	h ^= h >> 30;
+	h *= UINT64_C(0xbf58476d1ce4e5b9);
+	h ^= h >> 27;
+	h *= UINT64_C(0x94d049bb133111eb);
+	h ^= h >> 31;
+	return h;
+}
+
+/**
+ *  Return the slot of `(dev, ino)` or the empty slot where it would be
+ *  inserted. The table must not be full.
+ */
+static struct inode_set_slot *inode_set_slot(const struct inode_set *s, dev_t dev, ino_t ino) {
+	size_t i = inode_hash(dev, ino) & s->mask;
+	while(s->slots[i].value && (s->slots[i].ino != ino || s->slots[i].dev != dev)) {
+		i = (i + 1) & s->mask;
+	}
+	return &s->slots[i];
+}
+
+static int inode_set_grow(struct inode_set *s) {
+	size_t cap = s->slots ? (s->mask + 1) * 2 : 64;
+	struct inode_set_slot *slots = calloc(cap, sizeof(*slots));
+	if(!slots) {
+		return -1;
+	}
+	struct inode_set old = *s;
+	s->slots = slots;
+	s->mask = cap - 1;
+	if(old.slots) {
+		for(size_t i = 0; i <= old.mask; ++i) {
+			if(old.slots[i].value) {
+				*inode_set_slot(s, old.slots[i].dev, old.slots[i].ino) = old.slots[i];
+			}
+		}
+		free(old.slots);
+	}
+	return 0;
+}
+
+/**
+ *  Return the value stored for `(dev, ino)` or `NULL`.
+ */
+const void *inode_set_find(const struct inode_set *s, dev_t dev, ino_t ino) {
+	if(!s->slots) {
+		return NULL;
+	}
+	return inode_set_slot(s, dev, ino)->value;
+}
+
+/**
+ *  Insert `(dev, ino)` with `value`. Returns 1 if it was inserted, 0 if it was
+ *  already present (then its value is stored in `*existing` if
+ *  `existing != NULL`), and -1 if memory could not be allocated.
+ */
+int inode_set_insert(struct inode_set *s, dev_t dev, ino_t ino, const void *value, const void **existing) {
+	if(!s->slots || (s->len + 1) * 2 > s->mask + 1) {
+		if(inode_set_grow(s) < 0) {
+			return -1;
+		}
+	}
+	struct inode_set_slot *slot = inode_set_slot(s, dev, ino);
+	if(slot->value) {
+		if(existing) {
+			*existing = slot->value;
+		}
+		return 0;
+	}
+	*slot = (struct inode_set_slot){
+		.dev = dev,
+		.ino = ino,
+		.value = value,
+	};
+	++s->len;
+	return 1;
+}
+
+/**
+ *  Remove `(dev, ino)` if present.
+ */
+void inode_set_remove(struct inode_set *s, dev_t dev, ino_t ino) {
+	if(!s->slots) {
+		return;
+	}
+	struct inode_set_slot *slot = inode_set_slot(s, dev, ino);
+	if(!slot->value) {
+		return;
+	}
+	--s->len;
+	// Backward shift deletion: move following entries into the hole unless
+	// they are already between their home slot and the hole.
+	size_t hole = slot - s->slots;
+	size_t i = hole;
+	while(1) {
+		i = (i + 1) & s->mask;
+		if(!s->slots[i].value) {
+			break;
+		}
+		size_t home = inode_hash(s->slots[i].dev, s->slots[i].ino) & s->mask;
+		if(((i - home) & s->mask) >= ((i - hole) & s->mask)) {
+			s->slots[hole] = s->slots[i];
+			hole = i;
+		}
+	}
+	s->slots[hole].value = NULL;
+}
+
+void inode_keys_init(struct inode_keys *s) {
+	*s = (struct inode_keys){
+		.slots = NULL,
+		.mask = 0,
+		.len = 0,
+		.zero = 0,
+	};
+}
+
+void inode_keys_free(struct inode_keys *s) {
+	free(s->slots);
+	inode_keys_init(s);
+}
+
+static int inode_key_empty(const struct inode_key *k) {
+	return k->dev == 0 && k->ino == 0;
+}
+
+/**
+ *  Return the slot of `(dev, ino)` or the empty slot where it would be
+ *  inserted, like `inode_set_slot`.
+ */
+static struct inode_key *inode_keys_slot(const struct inode_keys *s, dev_t dev, ino_t ino) {
+	size_t i = inode_hash(dev, ino) & s->mask;
+	while(!inode_key_empty(&s->slots[i]) && (s->slots[i].ino != ino || s->slots[i].dev != dev)) {
+		i = (i + 1) & s->mask;
+	}
+	return &s->slots[i];
+}
+
+static int inode_keys_grow(struct inode_keys *s) {
+	size_t cap = s->slots ? (s->mask + 1) * 2 : 64;
+	struct inode_key *slots = calloc(cap, sizeof(*slots));
+	if(!slots) {
+		return -1;
+	}
+	struct inode_keys old = *s;
+	s->slots = slots;
+	s->mask = cap - 1;
+	if(old.slots) {
+		for(size_t i = 0; i <= old.mask; ++i) {
+			if(!inode_key_empty(&old.slots[i])) {
+				*inode_keys_slot(s, old.slots[i].dev, old.slots[i].ino) = old.slots[i];
+			}
+		}
+		free(old.slots);
+	}
+	return 0;
+}
+
+/**
+ *  Insert `(dev, ino)`. Returns 1 if it was inserted, 0 if it was already
+ *  present and -1 if memory could not be allocated.
+ */
+int inode_keys_insert(struct inode_keys *s, dev_t dev, ino_t ino) {
+	if(dev == 0 && ino == 0) {
+		int inserted = !s->zero;
+		s->zero = 1;
+		return inserted;
+	}
+	if(!s->slots || (s->len + 1) * 2 > s->mask + 1) {
+		if(inode_keys_grow(s) < 0) {
+			return -1;
+		}
+	}
+	struct inode_key *slot = inode_keys_slot(s, dev, ino);
+	if(!inode_key_empty(slot)) {
+		return 0;
+	}
+	*slot = (struct inode_key){
+		.dev = dev,
+		.ino = ino,
+	};
+	++s->len;
+	return 1;
+}
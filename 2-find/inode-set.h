@@ -0,0 +1,65 @@
+#ifndef INODE_SET_H
+#define INODE_SET_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ *  A slot of `struct inode_set`, `value == NULL` marks an empty slot.
+ */
+struct inode_set_slot {
+	dev_t dev;
+	ino_t ino;
+	const void *value;
+};
+
+/**
+ *  Hash set of `(st_dev, st_ino)` pairs with an associated non-NULL `value`.
+ *  Open addressing with linear probing in a power of two sized table that is
+ *  kept at most half full, removal shifts following slots back instead of
+ *  leaving tombstones.
+ */
+struct inode_set {
+	struct inode_set_slot *slots;
+	size_t mask;
+	size_t len;
+};
+
+void inode_set_init(struct inode_set *s);
+
+void inode_set_free(struct inode_set *s);
+
+const void *inode_set_find(const struct inode_set *s, dev_t dev, ino_t ino);
+
+int inode_set_insert(struct inode_set *s, dev_t dev, ino_t ino, const void *value, const void **existing);
+
+void inode_set_remove(struct inode_set *s, dev_t dev, ino_t ino);
+
+/**
+ *  A slot of `struct inode_keys`.
+ */
+struct inode_key {
+	dev_t dev;
+	ino_t ino;
+};
+
+/**
+ *  Hash set of `(st_dev, st_ino)` pairs without values, for sets that are only
+ *  added to, with 16 bytes per slot instead of 24. It is probed like
+ *  `struct inode_set`, `(0, 0)` marks an empty slot and `zero` is set if that
+ *  pair itself was inserted.
+ */
+struct inode_keys {
+	struct inode_key *slots;
+	size_t mask;
+	size_t len;
+	int zero;
+};
+
+void inode_keys_init(struct inode_keys *s);
+
+void inode_keys_free(struct inode_keys *s);
+
+int inode_keys_insert(struct inode_keys *s, dev_t dev, ino_t ino);
+
+#endif
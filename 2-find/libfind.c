@@ -0,0 +1,2977 @@
+#define _POSIX_C_SOURCE 200809L  // fstatat
+#define _GNU_SOURCE  // DTTOIF, statx
+#include <assert.h>
+#include <dirent.h>  // DT_*
+#include <errno.h>
+#include <fcntl.h>  // AT_SYMLINK_NOFOLLOW
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>  // SIZE_MAX
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>  // PATH_MAX
+#include <linux/stat.h>  // struct statx with stx_mnt_id (Linux 5.8)
+#include <sys/resource.h>  // getrlimit
+#include <sys/stat.h>
+#include <sys/sysmacros.h>  // makedev
+#include <time.h>  // clock_gettime
+#include <unistd.h>
+
+#include "dir-reader.h"
+#include "dir-sort.h"
+#include "index.h"
+#include "inode-set.h"
+#include "libfind.h"
+#include "mounts.h"
+#include "pool.h"
+#include "prefetch.h"
+#include "stats.h"
+#include "uring.h"
+#include "watch.h"
+
+// name ist stolen from busybox
+#define DOT_OR_DOTDOT(x) ((x)[0] == '.' && ((x)[1] == '\0' || ((x)[1] == '.' && (x)[2] == '\0')))
+
+/**
+ *  We store a linked list of `struct dir_chain` on the stack. Every callee
+ *  receives a pointer to the caller's `struct dir_chain` it can traverse.
+ *
+ *  The callee will receive a `dir_fd` of the parent directory and the `name`
+ *  of the current file. It can open it's on directory file descriptors with
+ *  `openat(dir_fd, name, ...)`. `type` is the `d_type` reported by the parent
+ *  directory, or `DT_UNKNOWN`. `path_len` is the length of the path up to and
+ *  including `name`, so the path of every element in the chain is a prefix of
+ *  the current path (see `struct find_path`).
+ *
+ *  When a directory is handed to another thread (see `struct find_task`) the
+ *  chain up to it is copied to the heap by `dir_chain_persist`, because the
+ *  stack frames it points to will be gone by then. Heap elements are shared by
+ *  all tasks below them and reference counted with `refs`, stack elements
+ *  have `refs == 0`.
+ *
+ *  When refreshing an index with `-build-index`, `old_entry` is the position
+ *  of the same file in the previous index, or `FIND_INDEX_NONE`.
+ *
+ *  `depth` is 0 for roots given on the command line. It cannot be taken from
+ *  the frame stack, because tasks start with an empty one.
+ *
+ *  Stack elements of frames remember their heap copy in `heap`, so all tasks
+ *  below a directory share it. With `depth` a directory is visited after
+ *  everything below it, and `pending` of a heap element counts what it still
+ *  waits for: 1 until its own entries are done, and 1 for every heap element
+ *  below it that was not visited yet, see `find_leave`.
+ */
+struct dir_chain {
+	const char *name;
+	int dir_fd;
+	unsigned char type;
+	size_t path_len;
+	size_t depth;
+	dev_t dev;
+	ino_t ino;
+	struct dir_chain *parent;
+	size_t refs;
+	struct dir_chain *heap;
+	size_t pending;
+	size_t old_entry;
+};
+
+#define FIND_INDEX_NONE ((size_t)-1)
+
+/**
+ *  Drop a reference to a heap `struct dir_chain` and free every element that
+ *  is no longer referenced.
+ */
+static void dir_chain_release(struct dir_chain *chain) {
+	while(chain && __atomic_sub_fetch(&chain->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+		struct dir_chain *parent = chain->parent;
+		free(chain);
+		chain = parent;
+	}
+}
+
+/**
+ *  Return a heap copy of `chain` with a reference for the caller. Elements that
+ *  already live on the heap are shared instead of copied, and so are the
+ *  copies that frames on the stack remember in `heap`. The copy's `dir_fd` is
+ *  -1, file descriptors are owned by whoever holds the reference. `chain`
+ *  itself is copied without remembering it, every other stack element is a
+ *  frame's `this` and keeps a reference to its copy until it is popped.
+ */
+static struct dir_chain *dir_chain_copy(struct dir_chain *chain, int remember) {
+	if(!chain) {
+		return NULL;
+	}
+	// We hold a reference to every heap element, so `refs` cannot drop to 0.
+	if(__atomic_load_n(&chain->refs, __ATOMIC_RELAXED)) {
+		__atomic_add_fetch(&chain->refs, 1, __ATOMIC_RELAXED);
+		return chain;
+	}
+	if(chain->heap) {
+		__atomic_add_fetch(&chain->heap->refs, 1, __ATOMIC_RELAXED);
+		return chain->heap;
+	}
+	struct dir_chain *parent = dir_chain_copy(chain->parent, 1);
+	if(chain->parent && !parent) {
+		return NULL;
+	}
+	size_t n = strlen(chain->name) + 1;
+	struct dir_chain *copy = malloc(sizeof(*copy) + n);
+	if(!copy) {
+		dir_chain_release(parent);
+		return NULL;
+	}
+	char *name = memcpy(copy + 1, chain->name, n);
+	*copy = (struct dir_chain){
+		.name = name,
+		.dir_fd = -1,
+		.type = chain->type,
+		.path_len = chain->path_len,
+		.depth = chain->depth,
+		.dev = chain->dev,
+		.ino = chain->ino,
+		.parent = parent,
+		.refs = remember ? 2 : 1,
+		.heap = NULL,
+		.pending = 1,
+		.old_entry = chain->old_entry,
+	};
+	if(parent) {
+		__atomic_add_fetch(&parent->pending, 1, __ATOMIC_RELAXED);
+	}
+	if(remember) {
+		chain->heap = copy;
+	}
+	return copy;
+}
+
+static struct dir_chain *dir_chain_persist(struct dir_chain *chain) {
+	return dir_chain_copy(chain, 0);
+}
+
+/**
+ *  The path of the file `find` currently looks at. Names are appended when
+ *  descending and the path is truncated again when returning, so it never has
+ *  to be rebuilt from the `struct dir_chain` to print it. It is always
+ *  null-terminated.
+ */
+struct find_path {
+	char *data;
+	size_t len;
+	size_t cap;
+};
+
+static int find_path_reserve(struct find_path *path, size_t len) {
+	if(len + 1 > path->cap) {
+		size_t cap = path->cap ? path->cap : 256;
+		while(len + 1 > cap) {
+			cap *= 2;
+		}
+		char *data = realloc(path->data, cap);
+		if(!data) {
+			return -1;
+		}
+		path->data = data;
+		path->cap = cap;
+	}
+	return 0;
+}
+
+/**
+ *  Append `name` separated by '/'. No '/' is added if the path is empty or the
+ *  previous element ended with `/`, so we do not print `//` for the root `/`.
+ */
+static int find_path_push(struct find_path *path, const char *name) {
+	size_t n = strlen(name);
+	size_t slash = path->len > 0 && path->data[path->len - 1] != '/';
+	if(find_path_reserve(path, path->len + slash + n) < 0) {
+		return -1;
+	}
+	if(slash) {
+		path->data[path->len] = '/';
+	}
+	memcpy(path->data + path->len + slash, name, n + 1);
+	path->len += slash + n;
+	return 0;
+}
+
+static void find_path_truncate(struct find_path *path, size_t len) {
+	path->len = len;
+	path->data[len] = '\0';
+}
+
+/**
+ *  Rebuild the path of `chain` from its elements' names and `path_len`. Used
+ *  when a thread starts a `struct find_task` that another thread created.
+ */
+static int find_path_set(struct find_path *path, const struct dir_chain *chain) {
+	if(find_path_reserve(path, chain->path_len) < 0) {
+		return -1;
+	}
+	for(const struct dir_chain *c = chain; c; c = c->parent) {
+		size_t n = strlen(c->name);
+		size_t start = c->path_len - n;
+		memcpy(path->data + start, c->name, n);
+		if(c->parent && start > c->parent->path_len) {
+			path->data[c->parent->path_len] = '/';
+		}
+	}
+	find_path_truncate(path, chain->path_len);
+	return 0;
+}
+
+/**
+ *  State of `-build-index`, see index.h. Every file `find` visits is appended
+ *  to `w` instead of being printed. `old` is the previous index at the same
+ *  path, or has `map == NULL` if there is none or it was built with other
+ *  options. A directory whose `st_dev`, `st_ino` and `st_mtim` did not change
+ *  since `old` was built is not read again, its entries are taken from `old`
+ *  (see `struct find_listing`).
+ */
+struct find_index {
+	struct index_writer w;
+	struct index old;
+};
+
+/**
+ *  Where a `struct find_frame` takes a directory's entries from: the directory
+ *  itself through `reader`, or, if `old != NULL`, the entries `next` up to
+ *  `end` of the previous index. The latter are the children of an unchanged
+ *  directory. With `-sorted`, `sort` holds all entries read from `reader`.
+ */
+struct find_listing {
+	struct dir_reader reader;
+	struct dir_sort *sort;
+	const struct index *old;
+	size_t next;
+	size_t end;
+};
+
+/**
+ *  Like `dir_reader_next`, additionally returns the position of the entry in
+ *  the previous index in `old_entry`, if it is taken from there.
+ */
+static int find_listing_next(struct find_listing *l, struct dir_entry *e, size_t *old_entry) {
+	if(!l->old) {
+		*old_entry = FIND_INDEX_NONE;
+		return l->sort ? dir_sort_next(l->sort, e) : dir_reader_next(&l->reader, e);
+	}
+	if(l->next >= l->end) {
+		return 0;
+	}
+	const struct index_entry *c = &l->old->entries[l->next];
+	*e = (struct dir_entry){
+		.ino = c->ino,
+		.type = c->d_type,
+		.name = index_name(l->old, c),
+	};
+	*old_entry = l->next;
+	l->next = c->end;
+	return 1;
+}
+
+/**
+ *  A child of a directory in the previous index, see `find_index_children`.
+ */
+struct find_index_child {
+	const char *name;
+	size_t entry;
+};
+
+static int find_index_child_cmp(const void *a, const void *b) {
+	return strcmp(
+		((const struct find_index_child *)a)->name,
+		((const struct find_index_child *)b)->name
+	);
+}
+
+/**
+ *  Return the children of the directory at `dir` in the previous index sorted
+ *  by name, so a changed directory can look up which of its entries were
+ *  already indexed. Returns `NULL` if there are none or on error, then the
+ *  directory's subtree is simply indexed from scratch.
+ */
+static struct find_index_child *find_index_children(const struct index *old, size_t dir, size_t *n) {
+	*n = 0;
+	const struct index_entry *entries = old->entries;
+	for(size_t i = dir + 1; i < entries[dir].end; i = entries[i].end) {
+		++*n;
+	}
+	if(*n == 0) {
+		return NULL;
+	}
+	struct find_index_child *children = malloc(*n * sizeof(*children));
+	if(!children) {
+		*n = 0;
+		return NULL;
+	}
+	size_t k = 0;
+	for(size_t i = dir + 1; i < entries[dir].end; i = entries[i].end) {
+		children[k++] = (struct find_index_child){
+			.name = index_name(old, &entries[i]),
+			.entry = i,
+		};
+	}
+	qsort(children, *n, sizeof(*children), find_index_child_cmp);
+	return children;
+}
+
+static size_t find_index_lookup(const struct find_index_child *children, size_t n, const char *name) {
+	struct find_index_child key = {.name = name};
+	const struct find_index_child *c = bsearch(&key, children, n, sizeof(*children), find_index_child_cmp);
+	return c ? c->entry : FIND_INDEX_NONE;
+}
+
+/**
+ *  Return the position of the root `name` in `idx`, or `FIND_INDEX_NONE`.
+ */
+static size_t find_index_root(const struct index *idx, const char *name) {
+	if(!idx->map) {
+		return FIND_INDEX_NONE;
+	}
+	for(size_t i = 0; i < idx->header->nentries; i = idx->entries[i].end) {
+		if(strcmp(index_name(idx, &idx->entries[i]), name) == 0) {
+			return i;
+		}
+	}
+	return FIND_INDEX_NONE;
+}
+
+/**
+ *  An entry read ahead by `-inode-order`, see `struct find_batch`. `name` is
+ *  an offset into the batch's `names`. `stat` is 1 if `st` and `mnt_id` were
+ *  filled in, -1 if stat(2) failed with `err`, and 0 if the entry was not
+ *  stat(2)ed. `fd` is the directory opened ahead by `-io-uring`, or -1.
+ *  `ahead` is the request of `-prefetch` that opens and reads it, or `NULL`.
+ */
+struct find_batch_entry {
+	ino_t ino;
+	unsigned char type;
+	size_t name;
+	size_t old_entry;
+	int stat;
+	int err;
+	int fd;
+	struct prefetch_req *ahead;
+	struct stat st;
+	uint64_t mnt_id;
+};
+
+/**
+ *  With `-inode-order`, up to `FIND_STAT_BATCH` entries of a directory are
+ *  read ahead, and those `find` will stat(2) are stat(2)ed in the order of
+ *  their `d_ino`. On ext4 and XFS that is the order of the inode tables, so
+ *  a cold cache reads them sequentially instead of seeking. The entries are
+ *  still returned in the order of the listing, `entries[next]` up to
+ *  `entries[n]`. `err` is a read error to return once the entries before it
+ *  are done. The arrays are reused for the next directory at the same depth,
+ *  unless they grew big. `ahead` is the first entry `find_batch_prefetch` did
+ *  not look at yet.
+ */
+struct find_batch {
+	struct find_batch_entry *entries;
+	size_t n;
+	size_t next;
+	size_t ahead;
+	size_t cap;
+	char *names;
+	size_t names_len;
+	size_t names_cap;
+	int err;
+};
+
+#define FIND_STAT_BATCH 1024
+#define FIND_BATCH_KEEP 64
+
+/**
+ *  Directories a thread keeps opened ahead with `-io-uring` or `-prefetch` at
+ *  most, the window of `struct prefetch`.
+ */
+#define FIND_OPEN_AHEAD 64
+
+/**
+ *  A directory being traversed, one per depth on an explicit stack instead of
+ *  the C stack, see `find_run`. `child` is the `struct dir_chain` of the entry
+ *  looked at, its parent is `this`, which is the `child` of the frame above, or
+ *  the root or task. `child.dir_fd` is the directory's file descriptor, it is
+ *  shared with `l.reader`. `buf` is the getdents64(2) buffer, it stays with the
+ *  frame, so it is reused for every directory at the same depth.
+ *
+ *  `old_children` are the directory's entries in the previous index when it
+ *  changed, see `find_index_children`. `entry` is the directory's position in
+ *  the index being built, its `end` is set when the frame is popped.
+ *
+ *  `sort` is the arena of `-sorted` and `batch` the read-ahead of
+ *  `-inode-order`, they are reused like `buf`.
+ *
+ *  When the file descriptor has to be closed to stay within `-fd-budget`,
+ *  `pos` remembers the getdents64(2) position, so the directory can be read on
+ *  after it is reopened, see `find_fd_reserve`.
+ *
+ *  `up` and `down` link the frames of neighbouring depths.
+ */
+struct find_frame {
+	struct dir_chain *this;
+	struct dir_chain child;
+	struct dir_buffer buf;
+	struct dir_sort sort;
+	struct find_batch batch;
+	struct find_listing l;
+	struct find_index_child *old_children;
+	size_t nold_children;
+	size_t entry;
+	off_t pos;
+	struct find_frame *up;
+	struct find_frame *down;
+};
+
+/**
+ *  Frames are allocated in chunks which are only freed by `find_args_free`, so
+ *  their `struct dir_chain` can point at each other, and the frames and their
+ *  buffers are reused for every root and task.
+ */
+#define FIND_FRAME_CHUNK 64
+
+struct find_frame_chunk {
+	struct find_frame_chunk *next;
+	struct find_frame frames[FIND_FRAME_CHUNK];
+};
+
+/**
+ *  `st_dev` and `st_ino` of every directory descended into so far, shared by
+ *  all threads, for `unique`. Unlike `ancestors` directories are never
+ *  removed, so a directory reached through several symlinks or bind mounts
+ *  is only traversed the first time.
+ */
+struct find_visited {
+	pthread_mutex_t lock;
+	struct inode_keys set;
+};
+
+/**
+ *  `opts`        what the caller asked for, see `struct find_options`
+ *  `err`         if `err != NULL` write errors to `err`
+ *  `err_prefix`  if `err_prefix` prefix all error messages with `err + ": "`
+ *  `mindepth`    files above this depth are not visited
+ *  `maxdepth`    directories at this depth are not descended into
+ *  `xdev`        if `xdev != -1` stop recursing if `st_dev != xdev`, set by
+ *                `find_descend` from the root
+ *  `excluded`    if `excluded != NULL` do not descend into these mounts
+ *                (`exclude_fstypes`)
+ *  `stat_flags`  passed to fstatat(2) (mainly `AT_SYMLINK_NOFOLLOW`)
+ *  `stat_mask`   the `STATX_*` fields `find_stat` asks for
+ *  `statx_flags` passed to statx(2) in addition to `stat_flags`
+ *                (`AT_STATX_DONT_SYNC` with `-dont-sync`)
+ *  `no_statx`    statx(2) is not available, use fstatat(2)
+ *  `pool`        if `pool != NULL` directories may be handed to other threads
+ *                as `struct find_task`
+ *  `worker`      index of the thread using these `struct find_args`
+ *  `chunks`      the frame stack of this thread, see `struct find_frame`
+ *  `top`         the frame of the directory being traversed, or `NULL`
+ *  `depth`       number of frames on the stack
+ *  `ancestors`   `st_dev` and `st_ino` of all directories this thread is
+ *                currently traversing, mapped to their `struct dir_chain`,
+ *                to detect file system loops without walking the chain
+ *  `seeded`      the heap `struct dir_chain` whose elements are in
+ *                `ancestors` for the tasks of this thread, with a reference,
+ *                see `find_task_seed`
+ *  `path`        path of the current file, see `struct find_path`
+ *  `index`       if `index != NULL` build an index instead of visiting, see
+ *                `struct find_index`
+ *  `fd_budget`   if `fd_budget != 0` keep at most this many directories open
+ *                on this thread, see `find_fd_reserve`
+ *  `closed`      the directories of the frames below `closed` had to be
+ *                closed to stay within `fd_budget`
+ *  `oldest`      the frame at depth `closed`
+ *  `queue`       if `queue != NULL` directories are appended to it instead of
+ *                being traversed right away (`-bfs`)
+ *  `have_stat`   `st` describes the current file, not only its type
+ *  `mnt_id`      the mount ID of the current file if statx(2) returned it,
+ *                else `MOUNTS_ID_UNKNOWN`, valid with `st`
+ *  `post_order`  visit directories after their entries (`depth`), see
+ *                `find_leave`
+ *  `sorted`      traverse the entries of every directory sorted by name
+ *  `inode_order` stat(2) entries in batches sorted by inode, see
+ *                `struct find_batch`
+ *  `stat_all`    the visitor needs stat(2) for every file
+ *  `prestat`     if `prestat != NULL` it has the stat(2) of the file `find`
+ *                is called for next
+ *  `io_uring`    stat(2) and open batches with `ring`, see
+ *                `find_batch_uring_stat`
+ *  `ring`        this thread's io_uring(7), `ring.fd < 0` if it is not
+ *                available, then `io_uring` only batches
+ *  `stx`         `URING_ENTRIES` results for `ring`
+ *  `prefetch`    if `prefetch != NULL` helpers open and read directories of
+ *                the batches ahead, see `find_batch_prefetch`
+ *  `open_ahead`  directories opened ahead by `find_batch_open`, or being
+ *                opened by `prefetch`, they count
+ *                against `fd_budget`
+ *  `watch`       if `watch != NULL` every directory traversed is watched for
+ *                new entries (`-watch`)
+ *  `visited`     if `visited != NULL` directories already traversed by any
+ *                thread are not descended into again (`-unique`)
+ *  `stats`       if `stats != NULL` count and time what we do (`-stats`)
+ *
+ *  Every thread has its own copy, because `st`, the frames, and `path` are
+ *  scratch space.
+ */
+struct find_args {
+	const struct find_options *opts;
+	FILE *err;
+	const char *err_prefix;
+	size_t mindepth;
+	size_t maxdepth;
+	dev_t xdev;
+	const struct mounts *excluded;
+	int stat_flags;
+	unsigned stat_mask;
+	int statx_flags;
+	int no_statx;
+	struct pool *pool;
+	size_t worker;
+	struct find_frame_chunk *chunks;
+	struct find_frame *top;
+	size_t depth;
+	struct inode_set ancestors;
+	struct dir_chain *seeded;
+	struct find_path path;
+	struct find_index *index;
+	size_t fd_budget;
+	size_t closed;
+	struct find_frame *oldest;
+	struct find_queue *queue;
+	int have_stat;
+	int post_order;
+	int sorted;
+	int inode_order;
+	int stat_all;
+	struct find_batch_entry *prestat;
+	int io_uring;
+	struct uring ring;
+	struct statx *stx;
+	struct prefetch *prefetch;
+	size_t open_ahead;
+	struct watch *watch;
+	struct find_visited *visited;
+	struct stats *stats;
+	struct stat st;
+	uint64_t mnt_id;
+};
+
+/**
+ *  Print error about the current path to `args->err`.
+ *  Format: "${prefix}${prefix+: }cannot ${verb} ${path}: ${strerror}"
+ */
+static void find_error(const struct find_args *args, const char *verb) {
+	if(STATS_ON(args->stats)) {
+		++args->stats->errors;
+	}
+	if(args->err) {
+		int errbak = errno;
+		// keep the line together when several threads report errors
+		flockfile(args->err);
+		if(args->err_prefix) {
+			fprintf(args->err, "%s: ", args->err_prefix);
+		}
+		fprintf(args->err, "cannot %s %s: %s\n", verb, args->path.data, strerror(errbak));
+		funlockfile(args->err);
+		errno = errbak;
+	}
+}
+
+/**
+ *  Print an error that is not about a path to `args->err`, formatted like
+ *  printf(3).
+ */
+static void find_message(const struct find_args *args, const char *fmt, ...) {
+	if(STATS_ON(args->stats)) {
+		++args->stats->errors;
+	}
+	if(args->err) {
+		va_list ap;
+		va_start(ap, fmt);
+		flockfile(args->err);
+		if(args->err_prefix) {
+			fprintf(args->err, "%s: ", args->err_prefix);
+		}
+		vfprintf(args->err, fmt, ap);
+		fputc('\n', args->err);
+		funlockfile(args->err);
+		va_end(ap);
+	}
+}
+
+/**
+ *  A directory that is traversed by whichever thread takes it from the
+ *  `struct pool`. It owns an open `dir_fd` to the directory and a reference to
+ *  the persisted `dir` (see `dir_chain_persist`), so it does not depend on the
+ *  thread that created it. `xdev` is per root, so it travels with the task.
+ *  With `-bfs` tasks do not hold file descriptors, `dir_fd` is -1 and the
+ *  directory is opened by its path when the task runs.
+ */
+struct find_task {
+	struct dir_chain *dir;
+	int dir_fd;
+	dev_t xdev;
+};
+
+/**
+ *  Directories are only handed to the pool while the own deque holds fewer
+ *  tasks than this, otherwise we recurse on the current thread. This bounds
+ *  the number of file descriptors held by waiting tasks.
+ */
+#define FIND_TASK_QUEUE 16
+
+/**
+ *  First in, first out queue of `struct find_task` for `-bfs`, a ring buffer
+ *  like `struct pool_deque`.
+ */
+struct find_queue {
+	struct find_task **tasks;
+	size_t cap;
+	size_t head;
+	size_t len;
+};
+
+static int find_queue_push(struct find_queue *q, struct find_task *task) {
+	if(q->len == q->cap) {
+		size_t cap = q->cap ? q->cap * 2 : 64;
+		struct find_task **tasks = malloc(cap * sizeof(*tasks));
+		if(!tasks) {
+			return -1;
+		}
+		for(size_t i = 0; i < q->len; ++i) {
+			tasks[i] = q->tasks[(q->head + i) % q->cap];
+		}
+		free(q->tasks);
+		q->tasks = tasks;
+		q->cap = cap;
+		q->head = 0;
+	}
+	q->tasks[(q->head + q->len) % q->cap] = task;
+	++q->len;
+	return 0;
+}
+
+static struct find_task *find_queue_pop(struct find_queue *q) {
+	if(q->len == 0) {
+		return NULL;
+	}
+	struct find_task *task = q->tasks[q->head];
+	q->head = (q->head + 1) % q->cap;
+	--q->len;
+	return task;
+}
+
+/**
+ *  Open the directory `dir` by its path, which `args->path` has to start with.
+ *  Used when its file descriptor was closed or never opened (see
+ *  `find_fd_reserve` and `-bfs`). Paths longer than `PATH_MAX` are opened in
+ *  pieces that fit, relative to each other. Fails with `ESTALE` if it is not
+ *  the directory we saw before, because something was renamed in the
+ *  meantime.
+ */
+static int find_open_path(struct find_args *args, const struct dir_chain *dir) {
+	char *path = args->path.data;
+	char saved = path[dir->path_len];
+	path[dir->path_len] = '\0';
+	int fd;
+	if(dir->path_len < PATH_MAX) {
+		fd = openat(AT_FDCWD, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	} else {
+		// The root is opened as a whole, the rest is split at '/'.
+		const struct dir_chain *root = dir;
+		while(root->parent) {
+			root = root->parent;
+		}
+		size_t pos = root->path_len;
+		char c = path[pos];
+		path[pos] = '\0';
+		fd = openat(AT_FDCWD, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		path[pos] = c;
+		while(fd >= 0 && pos < dir->path_len) {
+			while(path[pos] == '/') {
+				++pos;
+			}
+			size_t end = dir->path_len;
+			if(end - pos >= PATH_MAX) {
+				end = pos + PATH_MAX - 1;
+				while(end > pos && path[end] != '/') {
+					--end;
+				}
+				if(end == pos) {
+					close(fd);
+					fd = -1;
+					errno = ENAMETOOLONG;
+					break;
+				}
+			}
+			c = path[end];
+			path[end] = '\0';
+			int next = openat(fd, &path[pos], O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+			int errbak = errno;
+			path[end] = c;
+			close(fd);
+			errno = errbak;
+			fd = next;
+			pos = end;
+		}
+	}
+	path[dir->path_len] = saved;
+	if(fd < 0) {
+		return -1;
+	}
+	struct stat st;
+	if(fstat(fd, &st) < 0 || st.st_dev != dir->dev || st.st_ino != dir->ino) {
+		close(fd);
+		errno = ESTALE;
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ *  Close the directory of the lowest recursion depth that is still open, so
+ *  another one can be opened. The parent of the current depth is never closed,
+ *  because it is needed to open its children. Returns -1 if there is nothing
+ *  to close.
+ */
+static int find_fd_close_oldest(struct find_args *args) {
+	if(args->closed + 1 >= args->depth) {
+		return -1;
+	}
+	struct find_frame *f = args->oldest;
+	f->pos = lseek(f->child.dir_fd, 0, SEEK_CUR);
+	if(f->pos < 0) {
+		return -1;
+	}
+	// Helpers may still be opening its entries relative to it.
+	if(args->prefetch) {
+		for(size_t i = f->batch.next; i < f->batch.n; ++i) {
+			if(f->batch.entries[i].ahead) {
+				prefetch_wait(args->prefetch, f->batch.entries[i].ahead);
+			}
+		}
+	}
+	close(f->child.dir_fd);
+	f->child.dir_fd = -1;
+	f->l.reader.fd = -1;
+	++args->closed;
+	args->oldest = f->down;
+	return 0;
+}
+
+/**
+ *  Make room for one more directory file descriptor on this thread, so that at
+ *  most `args->fd_budget` are open. The directories closed are the ones we
+ *  return to last, `find_fd_reopen` opens them again on the way back up.
+ */
+static void find_fd_reserve(struct find_args *args) {
+	while(
+		args->fd_budget
+		&& args->depth - args->closed + 1 + args->open_ahead > args->fd_budget
+		&& find_fd_close_oldest(args) == 0
+	) {
+	}
+}
+
+/**
+ *  Open the directory `dir` again, which `args->path` has to start with.
+ *  `child_fd` is a directory below it, or -1. Its ".." is usually `dir` and
+ *  saves resolving the whole path.
+ */
+static int find_open_up(struct find_args *args, const struct dir_chain *dir, int child_fd) {
+	int fd = child_fd >= 0 ? openat(child_fd, "..", O_RDONLY | O_DIRECTORY | O_CLOEXEC) : -1;
+	if(fd >= 0) {
+		struct stat st;
+		if(fstat(fd, &st) < 0 || st.st_dev != dir->dev || st.st_ino != dir->ino) {
+			// a symlink we followed, or it was moved
+			close(fd);
+			fd = -1;
+		}
+	}
+	if(fd < 0) {
+		fd = find_open_path(args, dir);
+	}
+	return fd;
+}
+
+/**
+ *  Reopen the closed directory of frame `f` before `find_run` returns to it.
+ *  `child_fd` is the directory we are returning from, see `find_open_up`. If
+ *  reopening fails, the error is reported and the frame stops.
+ */
+static void find_fd_reopen(struct find_args *args, struct find_frame *f, int child_fd) {
+	const struct dir_chain *dir = f->this;
+	int fd = find_open_up(args, dir, child_fd);
+	if(fd >= 0 && lseek(fd, f->pos, SEEK_SET) < 0) {
+		int errbak = errno;
+		close(fd);
+		errno = errbak;
+		fd = -1;
+	}
+	if(fd < 0) {
+		size_t len = args->path.len;
+		find_path_truncate(&args->path, dir->path_len);
+		find_error(args, "reopen");
+		find_path_truncate(&args->path, len);
+	}
+	f->child.dir_fd = fd;
+	f->l.reader.fd = fd;
+	--args->closed;
+	args->oldest = f;
+}
+
+static int find_frame_push(struct find_args *args, struct dir_chain *this, int dir_fd, size_t listing, size_t entry, struct prefetch_req *ahead);
+
+/**
+ *  Decide whether `find` has to stat(2) `this`, or if its `d_type` is enough.
+ *  We need `st_dev` and `st_ino` of directories we descend into to detect file
+ *  system loops and for `-xdev`, and with `-follow` the type of a symlink's
+ *  target. Visitors that need more than the type stat(2) lazily, see
+ *  `find_entry_stat`.
+ */
+static int find_needs_stat(const struct find_args *args, const struct dir_chain *this) {
+	switch(this->type) {
+	case DT_UNKNOWN:
+		return 1;
+	case DT_DIR:
+		return this->depth < args->maxdepth;
+	case DT_LNK:
+		return !(args->stat_flags & AT_SYMLINK_NOFOLLOW);
+	default:
+		return 0;
+	}
+}
+
+/**
+ *  Copy what `find` uses from `stx` to `st`, and its mount ID to `mnt_id`.
+ */
+static void find_statx_copy(struct stat *st, uint64_t *mnt_id, const struct statx *stx) {
+	st->st_mode = stx->stx_mode;
+	st->st_ino = stx->stx_ino;
+	st->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+	st->st_size = stx->stx_size;
+	st->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+	st->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+	*mnt_id = stx->stx_mask & STATX_MNT_ID ? stx->stx_mnt_id : MOUNTS_ID_UNKNOWN;
+}
+
+/**
+ *  statx(2) with `flags` into `args->st`. Only the fields of `args->stat_mask`
+ *  are requested, the file system may skip the others, which saves round trips
+ *  on network file systems. Falls back to fstatat(2) if the kernel (or a
+ *  seccomp filter) does not know statx(2).
+ */
+static int find_statx(struct find_args *args, const struct dir_chain *this, int flags) {
+	if(!args->no_statx) {
+		struct statx stx;
+		if(statx(this->dir_fd, this->name, flags | args->statx_flags, args->stat_mask, &stx) == 0) {
+			find_statx_copy(&args->st, &args->mnt_id, &stx);
+			return 0;
+		}
+		if(errno != ENOSYS && errno != EPERM) {
+			return -1;
+		}
+		args->no_statx = 1;
+	}
+	args->mnt_id = MOUNTS_ID_UNKNOWN;
+	return fstatat(this->dir_fd, this->name, &args->st, flags);
+}
+
+/**
+ *  Call stat(2) on the file by directory file descriptor and its name
+ *  relative to the file descriptor ("/proc/self/fd/${dir_fd}/${name}") into
+ *  `args->st`. Avoids some file system race conditions, but mainly lets us
+ *  avoid string manipulation.
+ */
+static int find_stat_quiet(struct find_args *args, const struct dir_chain *this) {
+	uint64_t start = STATS_ON(args->stats) ? stats_now() : 0;
+	int ret = find_statx(args, this, args->stat_flags);
+	// Redo stat(2) if the issue may have been a dangling symlink.
+	if(ret < 0 && errno == ENOENT && !(args->stat_flags & AT_SYMLINK_NOFOLLOW)) {
+		ret = find_statx(args, this, args->stat_flags | AT_SYMLINK_NOFOLLOW);
+	}
+	if(STATS_ON(args->stats)) {
+		int errbak = errno;
+		stats_time(args->stats, STATS_STAT, start);
+		errno = errbak;
+	}
+	return ret;
+}
+
+/**
+ *  `find_stat_quiet` that reports errors and marks `args->st` as valid.
+ */
+static int find_stat(struct find_args *args, const struct dir_chain *this) {
+	if(find_stat_quiet(args, this) < 0) {
+		find_error(args, "stat");
+		return -1;
+	}
+	args->have_stat = 1;
+	return 0;
+}
+
+/**
+ *  What `struct find_entry` refers to, `priv` points to it. Without
+ *  `can_stat` the file is in an index.
+ */
+struct find_visit {
+	struct find_args *args;
+	const struct dir_chain *this;
+	int can_stat;
+};
+
+/**
+ *  Return the stat(2) of the file, which is done when it is first asked for,
+ *  unless the traversal needed it already. Returns `NULL` after reporting an
+ *  error.
+ */
+const struct stat *find_entry_stat(const struct find_entry *e) {
+	struct find_visit *v = e->priv;
+	if(!v->can_stat) {
+		errno = ENOTSUP;
+		return NULL;
+	}
+	if(!v->args->have_stat && find_stat(v->args, v->this) < 0) {
+		return NULL;
+	}
+	return &v->args->st;
+}
+
+/**
+ *  Open the file with open(2) `flags`, relative to its directory's file
+ *  descriptor, so the kernel does not resolve its path again. Symlinks are
+ *  only followed with `follow`. Returns -1 on errors without reporting them.
+ */
+int find_entry_open(const struct find_entry *e, int flags) {
+	struct find_visit *v = e->priv;
+	if(!v->can_stat) {
+		errno = ENOTSUP;
+		return -1;
+	}
+	if(v->args->stat_flags & AT_SYMLINK_NOFOLLOW) {
+		flags |= O_NOFOLLOW;
+	}
+	return openat(v->this->dir_fd, v->this->name, flags | O_CLOEXEC);
+}
+
+/**
+ *  Remove the file with unlinkat(2) relative to its directory's file
+ *  descriptor, directories with `AT_REMOVEDIR`, which only works after their
+ *  entries were removed (see `depth`). Returns -1 on errors without reporting
+ *  them.
+ */
+int find_entry_unlink(const struct find_entry *e) {
+	struct find_visit *v = e->priv;
+	if(!v->can_stat) {
+		errno = ENOTSUP;
+		return -1;
+	}
+	return unlinkat(v->this->dir_fd, v->this->name, e->type == DT_DIR ? AT_REMOVEDIR : 0);
+}
+
+/**
+ *  Return the counters of the thread that found the file, to add to them, or
+ *  `NULL` without `stats`.
+ */
+struct stats *find_entry_stats(const struct find_entry *e) {
+	return ((struct find_visit *)e->priv)->args->stats;
+}
+
+/**
+ *  Fill in the `struct find_entry` of `this`, whose type is `mode`.
+ *
+ *  Names in a directory cannot contain '/' and their length is known from the
+ *  path, `args->path` ends with `this->name`, maybe preceded by a '/' that
+ *  `find_path_push` inserted. For roots the name is their last component.
+ */
+static void find_entry_init(struct find_args *args, const struct dir_chain *this, mode_t mode, struct find_visit *v, struct find_entry *e) {
+	*e = (struct find_entry){
+		.path = args->path.data,
+		.path_len = args->path.len,
+		.root = !this->parent,
+		.type = IFTODT(mode),
+		.depth = this->depth,
+		.worker = args->worker,
+		.priv = v,
+	};
+	size_t start;
+	if(this->parent) {
+		start = this->parent->path_len;
+		if(args->path.data[start] == '/') {
+			++start;
+		}
+	} else {
+		start = strlen(this->name);
+		while(start > 1 && this->name[start - 1] == '/') {
+			--start;
+		}
+		while(start > 0 && this->name[start - 1] != '/') {
+			--start;
+		}
+	}
+	e->name = start;
+}
+
+/**
+ *  Call the visitor for `this` with the file type `mode`. Shared by the
+ *  traversal and `-index` queries, which cannot stat(2) (`can_stat == 0`).
+ *  Returns -1 on errors, otherwise 1 if the subtree of `this` is pruned.
+ */
+static int find_visit(struct find_args *args, const struct dir_chain *this, mode_t mode, int can_stat) {
+	if(this->depth < args->mindepth) {
+		return 0;
+	}
+	struct find_visit v = {
+		.args = args,
+		.this = this,
+		.can_stat = can_stat,
+	};
+	struct find_entry e;
+	find_entry_init(args, this, mode, &v, &e);
+	int ret;
+	if(STATS_ON(args->stats)) {
+		uint64_t start = stats_now();
+		ret = args->opts->visit(args->opts->ctx, &e);
+		stats_time(args->stats, STATS_MATCH, start);
+		if(ret > 0 && ret & FIND_MATCH) {
+			++args->stats->matches;
+		}
+	} else {
+		ret = args->opts->visit(args->opts->ctx, &e);
+	}
+	if(ret < 0) {
+		return -1;
+	}
+	return ret & FIND_PRUNE ? 1 : 0;
+}
+
+/**
+ *  Append `this` to the index being built and return its position in it.
+ *  `args->st` must be valid for directories.
+ */
+static size_t find_index_add(struct find_args *args, const struct dir_chain *this) {
+	struct index_entry *e = index_writer_add(&args->index->w, this->name, args->depth);
+	if(!e) {
+		find_error(args, "index");
+		return FIND_INDEX_NONE;
+	}
+	e->type = IFTODT(args->st.st_mode);
+	e->d_type = this->type;
+	e->ino = this->ino;
+	if(S_ISDIR(args->st.st_mode)) {
+		e->dev = args->st.st_dev;
+		e->mtime_sec = args->st.st_mtim.tv_sec;
+		e->mtime_nsec = args->st.st_mtim.tv_nsec;
+	}
+	return args->index->w.nentries - 1;
+}
+
+/**
+ *  Whether the directory `this`, described by `args->st`, did not change since
+ *  the previous index was built, so its entries can be taken from there.
+ *  Directories modified shortly before the previous index was built are read
+ *  again, because they might have changed again after it read them without a
+ *  visible change of their coarse-grained `st_mtim`.
+ */
+static int find_index_unchanged(const struct find_args *args, const struct dir_chain *this) {
+	if(this->old_entry == FIND_INDEX_NONE) {
+		return 0;
+	}
+	const struct index *old = &args->index->old;
+	const struct index_entry *e = &old->entries[this->old_entry];
+	return e->type == DT_DIR
+		&& e->dev == (uint64_t)args->st.st_dev
+		&& e->ino == (uint64_t)args->st.st_ino
+		&& e->mtime_sec == args->st.st_mtim.tv_sec
+		&& e->mtime_nsec == (uint32_t)args->st.st_mtim.tv_nsec
+		&& e->mtime_sec + 1 < old->header->built_sec;
+}
+
+/**
+ *  The first half of `find`: stat(2) `this` if necessary and detect file
+ *  system loops. Returns 1 if it is to be visited, 0 if not because we build
+ *  an index, and -1 on errors. `args->st` describes it (or only its type)
+ *  until `find_descend`.
+ */
+static int find_enter(struct find_args *args, struct dir_chain *this) {
+	// Files whose type we know from the directory entry and that we do not
+	// descend into do not need stat(2) unless the visitor asks for it, they
+	// cannot cause a file system loop.
+	args->have_stat = 0;
+	const struct find_batch_entry *pre = args->prestat;
+	if(pre) {
+		// `-inode-order` or `-io-uring` did stat(2) it already.
+		if(pre->stat < 0) {
+			errno = pre->err;
+			find_error(args, "stat");
+			return -1;
+		}
+		args->st = pre->st;
+		args->mnt_id = pre->mnt_id;
+		args->have_stat = 1;
+	} else if(!find_needs_stat(args, this)) {
+		args->st.st_mode = DTTOIF(this->type);
+		if(STATS_ON(args->stats)) {
+			++args->stats->stats_skipped;
+		}
+		return !args->index;
+	} else if(find_stat(args, this) < 0) {
+		return -1;
+	}
+
+	// detect file system loop
+	this->dev = args->st.st_dev;
+	this->ino = args->st.st_ino;
+	const struct dir_chain *c = inode_set_find(&args->ancestors, this->dev, this->ino);
+	if(c) {
+		if(STATS_ON(args->stats)) {
+			++args->stats->errors;
+		}
+		if(args->err) {
+			int errbak = errno;
+			flockfile(args->err);
+			if(args->err_prefix) {
+				fprintf(args->err, "%s: ", args->err_prefix);
+			}
+			fputs("file system loop detected: ", args->err);
+			fwrite(args->path.data, 1, args->path.len, args->err);
+			fputs(" = ", args->err);
+			fwrite(args->path.data, 1, c->path_len, args->err);
+			fputc('\n', args->err);
+			funlockfile(args->err);
+			errno = errbak;
+		}
+		return -1;
+	}
+	return !args->index;
+}
+
+/**
+ *  Add the directory described by `args->st` to `args->visited`. Returns 1 if
+ *  it was not traversed before, 0 if it was and -1 on errors.
+ */
+static int find_visited_insert(struct find_args *args) {
+	struct find_visited *v = args->visited;
+	pthread_mutex_lock(&v->lock);
+	int ret = inode_keys_insert(&v->set, args->st.st_dev, args->st.st_ino);
+	pthread_mutex_unlock(&v->lock);
+	if(ret < 0) {
+		find_error(args, "remember");
+	} else if(ret == 0 && STATS_ON(args->stats)) {
+		++args->stats->dirs_seen;
+	}
+	return ret;
+}
+
+/**
+ *  The second half of `find`, after `this` was visited: if it is a directory
+ *  to descend into and not pruned, push a `struct find_frame` for `find_run`
+ *  (or hand it to another thread). `args->prestat` is the batch entry of
+ *  `this`, if any. Returns 1 if we descend into `this`, 0 if not and -1 on
+ *  errors.
+ */
+static int find_descend(struct find_args *args, struct dir_chain *this, int prune) {
+	struct find_batch_entry *pre = args->prestat;
+	args->prestat = NULL;
+
+	// `-build-index` records every file instead of visiting it.
+	size_t entry = FIND_INDEX_NONE;
+	if(args->index) {
+		entry = find_index_add(args, this);
+		if(entry == FIND_INDEX_NONE) {
+			return -1;
+		}
+	}
+
+	// we cannot recurse into non-directories
+	if(!S_ISDIR(args->st.st_mode)) {
+		return 0;
+	}
+
+	// Pruned directories and those at `-maxdepth` are not even opened.
+	if(prune || this->depth >= args->maxdepth) {
+		return 0;
+	}
+
+	// st_dev changed, so we crossed onto another file system, stop recursion.
+	// The root was stat(2)ed by `find_enter` like any directory, so its
+	// st_dev costs nothing extra.
+	if(this->depth == 0 && args->opts->xdev) {
+		assert(args->st.st_dev != (dev_t)-1);  // we use (dev_t)-1 as a special value
+		args->xdev = args->st.st_dev;
+	}
+	if(args->xdev != (dev_t)-1 && args->st.st_dev != args->xdev) {
+		return 0;
+	}
+
+	// `-exclude-fstype` mounts are visited but not descended into, by their
+	// mount ID, which came with the statx(2) we needed anyway.
+	if(args->excluded && mounts_excluded(args->excluded, args->mnt_id, args->st.st_dev)) {
+		return 0;
+	}
+
+	// `-unique` traverses every directory once, no matter how it is reached.
+	if(args->visited) {
+		int ret = find_visited_insert(args);
+		if(ret <= 0) {
+			return ret;
+		}
+	}
+
+	// Take the entries of unchanged directories from the previous index.
+	size_t listing = FIND_INDEX_NONE;
+	if(args->index && find_index_unchanged(args, this)) {
+		listing = this->old_entry;
+	}
+
+	// With `-bfs` the directory is traversed once the directories queued
+	// before it are done. It is opened then, so queued directories do not
+	// hold file descriptors.
+	if(args->queue) {
+		struct find_task *task = malloc(sizeof(*task));
+		if(task) {
+			*task = (struct find_task){
+				.dir = dir_chain_persist(this),
+				.dir_fd = -1,
+				.xdev = args->xdev,
+			};
+			if(task->dir && find_queue_push(args->queue, task) == 0) {
+				return 1;
+			}
+			dir_chain_release(task->dir);
+			free(task);
+		}
+		find_error(args, "queue");
+		return -1;
+	}
+
+	// Open a new directory file descriptor to access children of the current
+	// directory. We cannot use O_PATH because we later use getdents64(2).
+	// If we run out of file descriptors, close directories we do not need
+	// right now and try again.
+	// `-prefetch` opened it already, or is still busy with it.
+	struct prefetch_req *ahead = NULL;
+	if(pre && pre->ahead) {
+		ahead = pre->ahead;
+		pre->ahead = NULL;
+		uint64_t start = STATS_ON(args->stats) ? stats_now() : 0;
+		prefetch_wait(args->prefetch, ahead);
+		if(STATS_ON(args->stats)) {
+			stats_time(args->stats, STATS_OPEN, start);
+		}
+		if(ahead->fd >= 0) {
+			pre->fd = ahead->fd;
+			ahead->fd = -1;
+		} else {
+			// open it ourselves, to report the error
+			--args->open_ahead;
+		}
+	}
+
+	int dir_fd;
+	if(pre && pre->fd >= 0) {
+		// `-io-uring` or `-prefetch` opened it already.
+		dir_fd = pre->fd;
+		pre->fd = -1;
+		--args->open_ahead;
+	} else {
+		find_fd_reserve(args);
+		uint64_t start = STATS_ON(args->stats) ? stats_now() : 0;
+		while(
+			(dir_fd = openat(this->dir_fd, this->name, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0
+			&& errno == EMFILE
+			&& find_fd_close_oldest(args) == 0
+		) {
+		}
+		if(STATS_ON(args->stats)) {
+			stats_time(args->stats, STATS_OPEN, start);
+		}
+		if(dir_fd < 0) {
+			find_error(args, "open");
+			if(ahead) {
+				prefetch_release(args->prefetch, ahead);
+			}
+			return -1;
+		}
+	}
+
+	// Hand the directory to another thread if there is not enough queued work.
+	// If that fails we just traverse it ourselves.
+	if(args->pool && pool_queued(args->pool, args->worker) < FIND_TASK_QUEUE) {
+		struct find_task *task = malloc(sizeof(*task));
+		if(task) {
+			*task = (struct find_task){
+				.dir = dir_chain_persist(this),
+				.dir_fd = dir_fd,
+				.xdev = args->xdev,
+			};
+			if(task->dir && pool_push(args->pool, args->worker, task) == 0) {
+				return 1;
+			}
+			if(task->dir && task->dir->parent) {
+				// the parent is still being read, so it does not drop to 0
+				__atomic_sub_fetch(&task->dir->parent->pending, 1, __ATOMIC_RELAXED);
+			}
+			dir_chain_release(task->dir);
+			free(task);
+		}
+	}
+
+	int ret = find_frame_push(args, this, dir_fd, listing, entry, ahead) < 0 ? -1 : 1;
+	if(ahead) {
+		prefetch_release(args->prefetch, ahead);
+	}
+	return ret;
+}
+
+/**
+ *  Implements find(1) for a single file: stat(2) it if necessary, visit it,
+ *  and if it is a directory to descend into, push a `struct find_frame` for
+ *  `find_run` (or hand it to another thread).
+ *  `args` base arguments, see `struct find_args`
+ *  `this` see `struct dir_chain`
+ *  `args->st` is scratch space, it only describes `this` until we return.
+ *
+ *  With `depth` files are visited after `find_descend`, and only if we do
+ *  not descend into them, otherwise `find_leave` visits them. They cannot be
+ *  pruned then.
+ */
+static int find(struct find_args *args, struct dir_chain *this) {
+	int visit = find_enter(args, this);
+	int prune = 0;
+	if(visit > 0 && !args->post_order) {
+		prune = find_visit(args, this, args->st.st_mode, 1);
+	}
+	if(visit < 0 || prune < 0) {
+		args->prestat = NULL;
+		return -1;
+	}
+	int ret = find_descend(args, this, prune);
+	// A directory we cannot open is still visited, like find(1) does.
+	if(visit > 0 && args->post_order && ret <= 0 && find_visit(args, this, args->st.st_mode, 1) < 0) {
+		ret = -1;
+	}
+	return ret < 0 ? -1 : 0;
+}
+
+/**
+ *  Free the frames allocated by `find_frame_push`.
+ */
+static void find_args_free(struct find_args *args) {
+	while(args->chunks) {
+		struct find_frame_chunk *chunk = args->chunks;
+		for(size_t i = 0; i < FIND_FRAME_CHUNK; ++i) {
+			dir_buffer_free(&chunk->frames[i].buf);
+			dir_sort_free(&chunk->frames[i].sort);
+			free(chunk->frames[i].batch.entries);
+			free(chunk->frames[i].batch.names);
+		}
+		args->chunks = chunk->next;
+		free(chunk);
+	}
+	args->top = NULL;
+	if(args->ring.fd >= 0) {
+		uring_free(&args->ring);
+	}
+	free(args->stx);
+	args->stx = NULL;
+	inode_set_free(&args->ancestors);
+	dir_chain_release(args->seeded);
+	args->seeded = NULL;
+	free(args->path.data);
+	args->path = (struct find_path){0};
+}
+
+/**
+ *  Allocate what `find_args_free` frees. Everything else is copied from the
+ *  template `args`.
+ */
+static int find_args_init(struct find_args *args) {
+	args->chunks = NULL;
+	args->top = NULL;
+	args->depth = 0;
+	args->closed = 0;
+	args->oldest = NULL;
+	inode_set_init(&args->ancestors);
+	args->seeded = NULL;
+	args->path = (struct find_path){0};
+	args->ring.fd = -1;
+	args->stx = NULL;
+	args->open_ahead = 0;
+	// Without io_uring(7) we fall back to stat(2)ing the batches ourselves.
+	if(args->io_uring && !args->no_statx && uring_init(&args->ring) == 0) {
+		args->stx = malloc(URING_ENTRIES * sizeof(*args->stx));
+		if(!args->stx) {
+			uring_free(&args->ring);
+		}
+	}
+	if(find_path_reserve(&args->path, 0) < 0) {
+		find_args_free(args);
+		return -1;
+	}
+	find_path_truncate(&args->path, 0);
+	return 0;
+}
+
+/**
+ *  Return the frame for the next depth, allocating a chunk if necessary.
+ */
+static struct find_frame *find_frame_next(struct find_args *args) {
+	if(args->top && args->top->down) {
+		return args->top->down;
+	}
+	if(!args->top && args->chunks) {
+		return &args->chunks->frames[0];
+	}
+	struct find_frame_chunk *chunk = calloc(1, sizeof(*chunk));
+	if(!chunk) {
+		return NULL;
+	}
+	for(size_t i = 0; i < FIND_FRAME_CHUNK; ++i) {
+		chunk->frames[i].up = i > 0 ? &chunk->frames[i - 1] : args->top;
+		chunk->frames[i].down = i + 1 < FIND_FRAME_CHUNK ? &chunk->frames[i + 1] : NULL;
+	}
+	if(args->top) {
+		args->top->down = &chunk->frames[0];
+		// keep the list in depth order, so `find_args_free` finds all chunks
+		struct find_frame_chunk **last = &args->chunks;
+		while(*last) {
+			last = &(*last)->next;
+		}
+		*last = chunk;
+	} else {
+		args->chunks = chunk;
+	}
+	return &chunk->frames[0];
+}
+
+/**
+ *  Watch the directory of a frame that is pushed for `-watch`. It is watched
+ *  before it is read, so entries created while we read it are not missed,
+ *  but they may be printed twice. Running out of watches is reported once.
+ */
+static void find_watch_add(struct find_args *args, const struct dir_chain *this) {
+	if(args->watch->full || watch_add(args->watch, args->path.data, this->depth, args->xdev) == 0) {
+		return;
+	}
+	if(errno == ENOSPC) {
+		args->watch->full = 1;
+		find_error(args, "watch (see fs.inotify.max_user_watches)");
+	} else {
+		find_error(args, "watch");
+	}
+}
+
+/**
+ *  Push a frame to traverse the directory `this`. `dir_fd` is an open file
+ *  descriptor to `this` and will be closed when the frame is popped. If
+ *  `listing` is not `FIND_INDEX_NONE`, the entries are taken from the previous
+ *  index instead of reading the directory, see `struct find_index`. `entry` is
+ *  the position of `this` in the index being built. If `ahead != NULL`, its
+ *  first getdents64(2) batch is taken from `-prefetch`.
+ */
+static int find_frame_push(struct find_args *args, struct dir_chain *this, int dir_fd, size_t listing, size_t entry, struct prefetch_req *ahead) {
+	struct find_frame *f = find_frame_next(args);
+	// `this` is an ancestor of everything below it, until it is popped.
+	if(!f || inode_set_insert(&args->ancestors, this->dev, this->ino, this, NULL) < 0) {
+		find_error(args, "read directory");
+		int errbak = errno;
+		close(dir_fd);
+		errno = errbak;
+		return -1;
+	}
+	f->this = this;
+	// Prepare the `struct dir_chain` of the children.
+	f->child = (struct dir_chain){
+		.dir_fd = dir_fd,
+		.parent = this,
+	};
+	f->entry = entry;
+
+	// We read the directory with getdents64(2) through `struct dir_reader`,
+	// so we can keep using `dir_fd` for fstatat(2) and openat(2), instead of
+	// having to dup(2) it for fdopendir(3).
+	f->l = (struct find_listing){.old = NULL};
+	if(ahead && ahead->len > 0) {
+		// Swap buffers, the helper reads the next directory into ours.
+		struct dir_buffer buf = f->buf;
+		f->buf = ahead->buf;
+		ahead->buf = buf;
+		dir_reader_init_read(&f->l.reader, dir_fd, &f->buf, ahead->len);
+	} else {
+		dir_reader_init(&f->l.reader, dir_fd, &f->buf);
+	}
+	if(listing != FIND_INDEX_NONE) {
+		f->l.old = &args->index->old;
+		f->l.next = listing + 1;
+		f->l.end = f->l.old->entries[listing].end;
+	}
+
+	// `-sorted` reads the whole directory now, a read error is returned by
+	// `find_listing_next` after the entries that could be read.
+	if(args->sorted) {
+		uint64_t start = STATS_ON(args->stats) ? stats_now() : 0;
+		dir_sort_read(&f->sort, &f->l.reader);
+		if(STATS_ON(args->stats)) {
+			stats_time(args->stats, STATS_GETDENTS, start);
+		}
+		f->l.sort = &f->sort;
+	}
+
+	// A changed directory looks its entries up in the previous index, so
+	// unchanged subdirectories below it are still not read again.
+	f->old_children = NULL;
+	f->nold_children = 0;
+	if(args->index && listing == FIND_INDEX_NONE && this->old_entry != FIND_INDEX_NONE) {
+		f->old_children = find_index_children(&args->index->old, this->old_entry, &f->nold_children);
+	}
+
+	if(args->watch) {
+		find_watch_add(args, this);
+	}
+
+	if(!args->top) {
+		args->oldest = f;
+	}
+	args->top = f;
+	++args->depth;
+	return 0;
+}
+
+/**
+ *  Append an entry to the batch, copying its name.
+ */
+static int find_batch_add(struct find_batch *b, const struct dir_entry *e, size_t old_entry) {
+	size_t n = strlen(e->name) + 1;
+	if(b->n == b->cap) {
+		size_t cap = b->cap ? b->cap * 2 : 16;
+		struct find_batch_entry *entries = realloc(b->entries, cap * sizeof(*entries));
+		if(!entries) {
+			return -1;
+		}
+		b->entries = entries;
+		b->cap = cap;
+	}
+	if(b->names_len + n > b->names_cap) {
+		size_t cap = b->names_cap ? b->names_cap : 1024;
+		while(b->names_len + n > cap) {
+			cap *= 2;
+		}
+		char *names = realloc(b->names, cap);
+		if(!names) {
+			return -1;
+		}
+		b->names = names;
+		b->names_cap = cap;
+	}
+	memcpy(b->names + b->names_len, e->name, n);
+	b->entries[b->n++] = (struct find_batch_entry){
+		.ino = e->ino,
+		.type = e->type,
+		.name = b->names_len,
+		.old_entry = old_entry,
+		.stat = 0,
+		.fd = -1,
+		.ahead = NULL,
+	};
+	b->names_len += n;
+	return 0;
+}
+
+/**
+ *  Close the directory `find_batch_open` or `-prefetch` opened for an entry
+ *  that `find` did not take.
+ */
+static void find_batch_close(struct find_args *args, struct find_batch_entry *be) {
+	if(be->ahead) {
+		prefetch_release(args->prefetch, be->ahead);
+		be->ahead = NULL;
+		--args->open_ahead;
+	}
+	if(be->fd >= 0) {
+		close(be->fd);
+		be->fd = -1;
+		--args->open_ahead;
+	}
+}
+
+/**
+ *  Forget the batch of a frame that is popped.
+ */
+static void find_batch_reset(struct find_args *args, struct find_batch *b) {
+	for(size_t i = b->next; i < b->n; ++i) {
+		find_batch_close(args, &b->entries[i]);
+	}
+	b->n = 0;
+	b->next = 0;
+	b->ahead = 0;
+	b->names_len = 0;
+	b->err = 0;
+	if(b->cap > FIND_BATCH_KEEP) {
+		free(b->entries);
+		free(b->names);
+		*b = (struct find_batch){0};
+	}
+}
+
+/**
+ *  Visit the directory `this` after everything below it, for `depth`. `fd` is
+ *  the directory itself, or -1. Heap elements do not know the file descriptor
+ *  of their parent, so it is opened again for the visitor.
+ */
+static int find_leave_visit(struct find_args *args, const struct dir_chain *this, int fd) {
+	if(this->depth < args->mindepth) {
+		return 0;
+	}
+	struct dir_chain c = *this;
+	int parent_fd = -1;
+	if(this->refs) {
+		c.dir_fd = AT_FDCWD;
+		if(this->parent) {
+			parent_fd = find_open_up(args, this->parent, fd);
+			if(parent_fd < 0) {
+				find_error(args, "open parent of");
+				return -1;
+			}
+			c.dir_fd = parent_fd;
+		}
+	}
+	args->have_stat = 0;
+	args->st.st_mode = S_IFDIR;
+	int ret = find_visit(args, &c, S_IFDIR, 1);
+	if(parent_fd >= 0) {
+		close(parent_fd);
+	}
+	return ret < 0 ? -1 : 0;
+}
+
+/**
+ *  Visit the parents of the heap element `heap` that were only waiting for it,
+ *  see `find_leave`.
+ */
+static int find_leave_up(struct find_args *args, struct dir_chain *heap) {
+	int ret = 0;
+	struct dir_chain *up = heap->parent;
+	for(; up && __atomic_sub_fetch(&up->pending, 1, __ATOMIC_ACQ_REL) == 0; up = up->parent) {
+		if(find_path_set(&args->path, up) < 0) {
+			find_message(args, "%s", strerror(errno));
+			ret = -1;
+		} else if(find_leave_visit(args, up, -1) < 0) {
+			ret = -1;
+		}
+	}
+	return ret;
+}
+
+/**
+ *  Called for `depth` when the entries of the directory `this` are done, `fd`
+ *  is the directory or -1. It is visited now, unless other threads are still
+ *  traversing directories below it: whoever drops `pending` of its heap copy
+ *  to 0 visits it, and then the parents that were only waiting for it.
+ *  `args->path` has to be the path of `this`, it is overwritten for the
+ *  parents. That only happens when the last frame of a thread is popped,
+ *  because the parents of any other frame are still being read.
+ */
+static int find_leave(struct find_args *args, struct dir_chain *this, int fd) {
+	struct dir_chain *heap = this->refs ? this : this->heap;
+	if(heap && __atomic_sub_fetch(&heap->pending, 1, __ATOMIC_ACQ_REL) > 0) {
+		return 0;
+	}
+	int ret = find_leave_visit(args, this, fd);
+	if(heap && find_leave_up(args, heap) < 0) {
+		ret = -1;
+	}
+	return ret;
+}
+
+/**
+ *  Pop the top frame after its directory was traversed, and close it. `n` is
+ *  the last result of `find_listing_next`.
+ */
+static int find_frame_pop(struct find_args *args, int n) {
+	struct find_frame *f = args->top;
+	int ret = 0;
+	args->top = f->up;
+	--args->depth;
+	inode_set_remove(&args->ancestors, f->this->dev, f->this->ino);
+	free(f->old_children);
+	if(f->l.sort) {
+		dir_sort_reset(f->l.sort);
+	}
+	find_batch_reset(args, &f->batch);
+	if(n < 0) {
+		find_error(args, "read directory");
+		ret = -1;
+	}
+	if(args->index) {
+		// the subtree ends after the last entry added below it
+		args->index->w.entries[f->entry].end = args->index->w.nentries;
+	}
+
+	// The parent was closed to stay within `-fd-budget`, reopen it while we
+	// still have our own file descriptor.
+	if(args->depth > 0 && args->closed == args->depth) {
+		find_fd_reopen(args, args->top, f->child.dir_fd);
+	}
+
+	if(args->post_order && find_leave(args, f->this, f->child.dir_fd) < 0) {
+		ret = -1;
+	}
+	if(f->this->heap) {
+		dir_chain_release(f->this->heap);
+		f->this->heap = NULL;
+	}
+
+	int errbak = errno;
+	if(f->child.dir_fd >= 0 && close(f->child.dir_fd) < 0) {
+		find_error(args, "close");
+		// restore errno if there was a previous error
+		if(ret) {
+			errno = errbak;
+		}
+		ret = -1;
+	}
+	return ret;
+}
+
+/**
+ *  Return the next entry of the frame's listing, ignoring "." and "..", see
+ *  `find_listing_next`. With `-stats` the calls that have to read the next
+ *  batch with getdents64(2) are timed.
+ */
+static int find_frame_read(struct find_args *args, struct find_frame *f, struct dir_entry *e, size_t *old_entry) {
+	int n;
+	do {
+		if(STATS_ON(args->stats) && !f->l.old && !f->l.sort && f->l.reader.pos >= f->l.reader.end) {
+			uint64_t start = stats_now();
+			n = find_listing_next(&f->l, e, old_entry);
+			stats_time(args->stats, STATS_GETDENTS, start);
+		} else {
+			n = find_listing_next(&f->l, e, old_entry);
+		}
+	} while(n > 0 && DOT_OR_DOTDOT(e->name));
+	if(n > 0 && STATS_ON(args->stats)) {
+		++args->stats->entries;
+	}
+	return n;
+}
+
+/**
+ *  An entry of `struct find_batch` to stat(2), sorted by `ino`.
+ */
+struct find_batch_ino {
+	ino_t ino;
+	struct find_batch_entry *entry;
+};
+
+static int find_batch_ino_cmp(const void *a, const void *b) {
+	ino_t x = ((const struct find_batch_ino *)a)->ino;
+	ino_t y = ((const struct find_batch_ino *)b)->ino;
+	return x < y ? -1 : x > y;
+}
+
+/**
+ *  stat(2) `order[0]` up to `order[n]` with `args->ring`, `URING_ENTRIES` per
+ *  io_uring_enter(2). Returns how many were done, if submitting fails the ring
+ *  is not used anymore and the caller stat(2)s the rest. With `-stats` every
+ *  statx(2) is timed from the submission until it is reaped.
+ */
+static size_t find_batch_uring_stat(struct find_args *args, struct find_frame *f, const struct find_batch_ino *order, size_t n) {
+	struct find_batch *b = &f->batch;
+	struct dir_chain c = {
+		.dir_fd = f->child.dir_fd,
+	};
+	for(size_t i = 0; i < n; i += URING_ENTRIES) {
+		size_t m = n - i < URING_ENTRIES ? n - i : URING_ENTRIES;
+		uint64_t start = STATS_ON(args->stats) ? stats_now() : 0;
+		for(size_t j = 0; j < m; ++j) {
+			// cannot fail, the ring is empty and has room for `m`
+			uring_statx(&args->ring, c.dir_fd, b->names + order[i + j].entry->name, args->stat_flags | args->statx_flags, args->stat_mask, &args->stx[j], j);
+		}
+		if(uring_submit(&args->ring, m) < 0) {
+			uring_free(&args->ring);
+			return i;
+		}
+		for(size_t done = 0; done < m;) {
+			uint64_t j;
+			int res;
+			if(!uring_complete(&args->ring, &j, &res)) {
+				continue;
+			}
+			++done;
+			if(STATS_ON(args->stats)) {
+				stats_time(args->stats, STATS_STAT, start);
+			}
+			struct find_batch_entry *be = order[i + j].entry;
+			if(res == 0) {
+				find_statx_copy(&be->st, &be->mnt_id, &args->stx[j]);
+				be->stat = 1;
+			} else if(
+				// dangling symlinks and what `find_statx` falls back for
+				(res == -ENOENT && !(args->stat_flags & AT_SYMLINK_NOFOLLOW))
+				|| res == -ENOSYS || res == -EPERM || res == -EINVAL
+			) {
+				c.name = b->names + be->name;
+				if(find_stat_quiet(args, &c) < 0) {
+					be->stat = -1;
+					be->err = errno;
+				} else {
+					be->stat = 1;
+					be->st = args->st;
+					be->mnt_id = args->mnt_id;
+				}
+			} else {
+				be->stat = -1;
+				be->err = -res;
+			}
+		}
+	}
+	return n;
+}
+
+/**
+ *  How many more directories may be opened ahead: up to `FIND_OPEN_AHEAD`,
+ *  and half of what is left of `-fd-budget`.
+ */
+static size_t find_open_ahead_room(const struct find_args *args) {
+	size_t room = FIND_OPEN_AHEAD - args->open_ahead;
+	if(args->fd_budget) {
+		size_t open = args->depth - args->closed + 1 + args->open_ahead;
+		size_t half = open < args->fd_budget ? (args->fd_budget - open) / 2 : 0;
+		if(half < room) {
+			room = half;
+		}
+	}
+	return room;
+}
+
+/**
+ *  Open the directories of the batch `find` will descend into with one
+ *  submission, as far as `find_open_ahead_room` allows. `find` takes the file
+ *  descriptor from the entry, what it does not take is closed by
+ *  `find_batch_close`. Directories that cannot be opened here are opened by
+ *  `find`, which reports the error.
+ */
+static void find_batch_uring_open(struct find_args *args, struct find_frame *f) {
+	struct find_batch *b = &f->batch;
+	if(args->queue || args->index || f->this->depth + 1 >= args->maxdepth) {
+		return;
+	}
+	size_t room = find_open_ahead_room(args);
+	size_t m = 0;
+	uint64_t start = STATS_ON(args->stats) ? stats_now() : 0;
+	for(size_t i = b->next; i < b->n && m < room && m < URING_ENTRIES; ++i) {
+		const struct find_batch_entry *be = &b->entries[i];
+		if(
+			be->stat != 1
+			|| !S_ISDIR(be->st.st_mode)
+			|| (args->xdev != (dev_t)-1 && be->st.st_dev != args->xdev)
+			|| (args->excluded && mounts_excluded(args->excluded, be->mnt_id, be->st.st_dev))
+			|| inode_set_find(&args->ancestors, be->st.st_dev, be->st.st_ino)
+		) {
+			continue;
+		}
+		uring_openat(&args->ring, f->child.dir_fd, b->names + be->name, O_RDONLY | O_DIRECTORY | O_CLOEXEC, i);
+		++m;
+	}
+	if(m == 0) {
+		return;
+	}
+	if(uring_submit(&args->ring, m) < 0) {
+		uring_free(&args->ring);
+		return;
+	}
+	for(size_t done = 0; done < m;) {
+		uint64_t i;
+		int res;
+		if(!uring_complete(&args->ring, &i, &res)) {
+			continue;
+		}
+		++done;
+		if(STATS_ON(args->stats)) {
+			stats_time(args->stats, STATS_OPEN, start);
+		}
+		if(res >= 0) {
+			b->entries[i].fd = res;
+			++args->open_ahead;
+		}
+	}
+}
+
+/**
+ *  stat(2) the entries of the batch `find` would stat(2), in inode order with
+ *  `-inode-order`, and with io_uring(7) with `-io-uring`. Errors are reported
+ *  by `find` when it gets to the entry.
+ */
+static void find_batch_stat(struct find_args *args, struct find_frame *f) {
+	struct find_batch *b = &f->batch;
+	struct find_batch_ino *order = malloc(b->n * sizeof(*order));
+	if(!order) {
+		// `find` will stat(2) them one by one.
+		return;
+	}
+	struct dir_chain c = {
+		.dir_fd = f->child.dir_fd,
+		.depth = f->this->depth + 1,
+	};
+	size_t n = 0;
+	for(size_t i = 0; i < b->n; ++i) {
+		c.type = b->entries[i].type;
+		if(args->stat_all || find_needs_stat(args, &c)) {
+			order[n++] = (struct find_batch_ino){
+				.ino = b->entries[i].ino,
+				.entry = &b->entries[i],
+			};
+		}
+	}
+	if(args->inode_order) {
+		qsort(order, n, sizeof(*order), find_batch_ino_cmp);
+	}
+	size_t i = 0;
+	if(args->ring.fd >= 0) {
+		i = find_batch_uring_stat(args, f, order, n);
+	}
+	for(; i < n; ++i) {
+		struct find_batch_entry *be = order[i].entry;
+		c.name = b->names + be->name;
+		if(find_stat_quiet(args, &c) < 0) {
+			be->stat = -1;
+			be->err = errno;
+		} else {
+			be->stat = 1;
+			be->st = args->st;
+			be->mnt_id = args->mnt_id;
+		}
+	}
+	free(order);
+	if(args->ring.fd >= 0) {
+		find_batch_uring_open(args, f);
+	}
+}
+
+/**
+ *  Hand the subdirectories of the batch to the `-prefetch` helpers, from
+ *  `ahead` on, as far as `find_open_ahead_room` allows. It is called again
+ *  for every entry returned, so the window moves along the listing, and the
+ *  room freed by a directory that was descended into goes to its entries
+ *  first, which are returned before ours. Only `DT_DIR` entries are
+ *  prefetched, they are the only ones we know to be directories before
+ *  stat(2).
+ */
+static void find_batch_prefetch(struct find_args *args, struct find_frame *f) {
+	struct find_batch *b = &f->batch;
+	if(b->ahead < b->next) {
+		b->ahead = b->next;
+	}
+	if(b->ahead >= b->n || f->this->depth + 1 >= args->maxdepth) {
+		return;
+	}
+	for(size_t room = find_open_ahead_room(args); room > 0 && b->ahead < b->n; ++b->ahead) {
+		struct find_batch_entry *be = &b->entries[b->ahead];
+		if(be->type != DT_DIR) {
+			continue;
+		}
+		be->ahead = prefetch_submit(args->prefetch, f->child.dir_fd, b->names + be->name);
+		if(!be->ahead) {
+			break;
+		}
+		++args->open_ahead;
+		--room;
+	}
+}
+
+/**
+ *  `find_frame_read` for `-inode-order`, `-io-uring` and `-prefetch`: return
+ *  the next entry of the batch, after reading and stat(2)ing the next batch if
+ *  it is done. Sets `args->prestat` for `find`.
+ */
+static int find_frame_entry(struct find_args *args, struct find_frame *f, struct dir_entry *e, size_t *old_entry) {
+	if(!args->inode_order && !args->io_uring && !args->prefetch) {
+		return find_frame_read(args, f, e, old_entry);
+	}
+	struct find_batch *b = &f->batch;
+	if(b->next >= b->n) {
+		if(b->err) {
+			errno = b->err;
+			b->err = 0;
+			return -1;
+		}
+		b->n = 0;
+		b->next = 0;
+		b->ahead = 0;
+		b->names_len = 0;
+		int n = 1;
+		while(b->n < FIND_STAT_BATCH && (n = find_frame_read(args, f, e, old_entry)) > 0) {
+			if(find_batch_add(b, e, *old_entry) < 0) {
+				n = -1;
+				break;
+			}
+		}
+		if(n < 0) {
+			b->err = errno;
+		}
+		if(b->n == 0) {
+			b->err = 0;
+			return n;
+		}
+		// The helpers open while we stat(2).
+		if(args->prefetch) {
+			find_batch_prefetch(args, f);
+		}
+		find_batch_stat(args, f);
+	} else if(args->prefetch) {
+		find_batch_prefetch(args, f);
+	}
+	struct find_batch_entry *be = &b->entries[b->next++];
+	*e = (struct dir_entry){
+		.ino = be->ino,
+		.type = be->type,
+		.name = b->names + be->name,
+	};
+	*old_entry = be->old_entry;
+	args->prestat = be->stat ? be : NULL;
+	return 1;
+}
+
+/**
+ *  Return the `child` of the top frame set to its next entry, popping the
+ *  frames that are done. Returns `NULL` when the stack is empty, errors set
+ *  `*ret` to -1.
+ */
+static struct dir_chain *find_next(struct find_args *args, int *ret) {
+	while(args->top) {
+		struct find_frame *f = args->top;
+		// `args->path` still ends with the entry we looked at last, maybe in
+		// a frame that was popped since.
+		find_path_truncate(&args->path, f->this->path_len);
+
+		struct dir_entry e;
+		size_t old_entry;
+		int n;
+		// A closed frame that could not be reopened is done, see
+		// `find_fd_reopen`.
+		if(f->child.dir_fd < 0) {
+			*ret = -1;
+			n = 0;
+		} else {
+			n = find_frame_entry(args, f, &e, &old_entry);
+		}
+		if(n <= 0) {
+			if(find_frame_pop(args, n) < 0) {
+				*ret = -1;
+			}
+			continue;
+		}
+
+		if(find_path_push(&args->path, e.name) < 0) {
+			find_error(args, "read directory");
+			if(args->prestat) {
+				find_batch_close(args, args->prestat);
+				args->prestat = NULL;
+			}
+			*ret = -1;
+			continue;
+		}
+		struct dir_chain *child = &f->child;
+		child->name = e.name;
+		child->type = e.type;
+		child->path_len = args->path.len;
+		child->depth = f->this->depth + 1;
+		child->ino = e.ino;
+		child->old_entry = old_entry;
+		if(f->old_children) {
+			child->old_entry = find_index_lookup(f->old_children, f->nold_children, e.name);
+		}
+		// Now `child` will look like this:
+		// (struct dir_chain){
+		//     .name = e.name,
+		//     .dir_fd = /* file descriptor to the directory we are iterating */,
+		//     .type = e.type,
+		//     .path_len = /* `args->path` ends with "/${e.name}" */,
+		//     .depth = f->this->depth + 1,
+		//     .ino = e.ino,
+		//     .parent = f->this,
+		//     .old_entry = /* see `struct find_index` */,
+		// };
+		return child;
+	}
+	return NULL;
+}
+
+/**
+ *  Traverse the frames on the stack until it is empty. Instead of recursing,
+ *  `find` pushes a frame for every directory, and we continue with its
+ *  entries, so the depth of a tree is only limited by memory.
+ */
+static int find_run(struct find_args *args) {
+	int ret = 0;
+	struct dir_chain *child;
+	while((child = find_next(args, &ret))) {
+		struct find_batch_entry *pre = args->prestat;
+		if(find(args, child) < 0) {
+			ret = -1;
+		}
+		if(pre) {
+			find_batch_close(args, pre);
+		}
+	}
+	return ret;
+}
+
+/**
+ *  Per thread state when running with `-threads`.
+ */
+struct find_worker {
+	struct find_args args;
+	struct stats stats;
+	int ret;
+};
+
+/**
+ *  Make `ancestors` hold the elements of the heap chain `chain`, the parents
+ *  of the next task's directory, which were traversed before, maybe by some
+ *  other thread. Consecutive tasks of a thread are usually close to each
+ *  other, so only the elements below the last directory the old and the new
+ *  chain have in common are removed and added, instead of the whole chain for
+ *  every task. Returns -1 if `ancestors` cannot grow, they are the common
+ *  part then.
+ */
+static int find_task_seed(struct find_args *args, struct dir_chain *chain) {
+	struct dir_chain *old = args->seeded;
+	struct dir_chain *common = old;
+	for(struct dir_chain *c = chain; common != c;) {
+		if(!c || (common && common->depth > c->depth)) {
+			common = common->parent;
+		} else if(!common || c->depth > common->depth) {
+			c = c->parent;
+		} else {
+			common = common->parent;
+			c = c->parent;
+		}
+	}
+	// Remove first, a bind mount may put the same directory on both sides.
+	for(struct dir_chain *c = old; c != common; c = c->parent) {
+		inode_set_remove(&args->ancestors, c->dev, c->ino);
+	}
+	int ret = 0;
+	struct dir_chain *c;
+	for(c = chain; c != common; c = c->parent) {
+		if(inode_set_insert(&args->ancestors, c->dev, c->ino, c, NULL) < 0) {
+			break;
+		}
+	}
+	if(c != common) {
+		for(struct dir_chain *undo = chain; undo != c; undo = undo->parent) {
+			inode_set_remove(&args->ancestors, undo->dev, undo->ino);
+		}
+		chain = common;
+		ret = -1;
+	}
+	if(chain) {
+		__atomic_add_fetch(&chain->refs, 1, __ATOMIC_RELAXED);
+	}
+	args->seeded = chain;
+	dir_chain_release(old);
+	return ret;
+}
+
+/**
+ *  Traverse the directory of the `struct find_task` `t` and free `t`.
+ */
+static int find_task(struct find_args *args, struct find_task *t) {
+	int ret = 0;
+	int pushed = 0;
+	args->xdev = t->xdev;
+	if(find_path_set(&args->path, t->dir) < 0) {
+		// Without its path everything below it would be reported wrongly, so
+		// the task is skipped. Its directory is not visited either, but
+		// `depth` still visits its parents once they are done.
+		find_path_truncate(&args->path, 0);
+		find_message(args, "cannot read directory %s: %s", t->dir->name, strerror(errno));
+		if(t->dir_fd >= 0) {
+			close(t->dir_fd);
+		}
+		if(args->post_order && __atomic_sub_fetch(&t->dir->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+			find_leave_up(args, t->dir);
+		}
+		dir_chain_release(t->dir);
+		free(t);
+		return -1;
+	}
+	if(t->dir_fd < 0) {
+		uint64_t start = STATS_ON(args->stats) ? stats_now() : 0;
+		t->dir_fd = find_open_path(args, t->dir);
+		if(STATS_ON(args->stats)) {
+			stats_time(args->stats, STATS_OPEN, start);
+		}
+		if(t->dir_fd < 0) {
+			find_error(args, "open");
+			ret = -1;
+			goto out;
+		}
+	}
+	// `find_frame_push` adds `t->dir` itself.
+	if(find_task_seed(args, t->dir->parent) < 0) {
+		find_error(args, "read directory");
+		close(t->dir_fd);
+		ret = -1;
+	} else if(find_frame_push(args, t->dir, t->dir_fd, FIND_INDEX_NONE, FIND_INDEX_NONE, NULL) < 0) {
+		ret = -1;
+	} else {
+		pushed = 1;
+		if(find_run(args) < 0) {
+			ret = -1;
+		}
+	}
+out:
+	// A directory that could not be read is done as well, popping its frame
+	// would have called `find_leave`.
+	if(!pushed && args->post_order && find_leave(args, t->dir, -1) < 0) {
+		ret = -1;
+	}
+	dir_chain_release(t->dir);
+	free(t);
+	return ret;
+}
+
+/**
+ *  Run a `struct find_task` on the worker with index `worker`, see `struct pool`.
+ */
+static void find_task_run(void *ctx, size_t worker, void *task) {
+	struct find_worker *w = &((struct find_worker *)ctx)[worker];
+	if(find_task(&w->args, task) < 0) {
+		w->ret = -1;
+	}
+}
+
+/**
+ *  Prepare `struct find_args` and the `struct dir_chain` `root` for `find`.
+ *  With `-xdev`, `find_descend` takes the expected `dev_t` from the root's
+ *  stat(2). `args` belongs to the calling thread, only `args->xdev` and
+ *  `args->path` are changed.
+ */
+static int find_root(struct find_args *args, const char *name, struct dir_chain *root) {
+	// We cannot remove trailing / from `name` here, so that `find_path_push`
+	// does not append //, because `a` and `a/` might be different paths when
+	// symlinks are involved and the path `/`.
+	find_path_truncate(&args->path, 0);
+	if(find_path_push(&args->path, name) < 0) {
+		find_error(args, "open");
+		return -1;
+	}
+	*root = (struct dir_chain){
+		.name = name,
+		.dir_fd = AT_FDCWD,
+		.path_len = args->path.len,
+		.depth = 0,
+		.parent = NULL,
+		.old_entry = args->index ? find_index_root(&args->index->old, name) : FIND_INDEX_NONE,
+	};
+	args->xdev = -1;
+	return 0;
+}
+
+/**
+ *  Traverse the root `name` on the calling thread, see `find_root`.
+ */
+static int find_prepare(struct find_args *args, const char *name) {
+	struct dir_chain root;
+	int ret = find_root(args, name, &root);
+	if(ret != 0) {
+		return ret;
+	}
+	// `root` stays on our stack until `find_run` is done with everything
+	// below it. The ancestors of earlier tasks are none of its ancestors.
+	find_task_seed(args, NULL);
+	ret = find(args, &root);
+	if(find_run(args) < 0) {
+		ret = -1;
+	}
+	return ret;
+}
+
+/**
+ *  Implements `-bfs`: `find` appends directories to a `struct find_queue`
+ *  instead of recursing, and they are traversed in that order, level by level.
+ *  Every root is done before the next one starts.
+ */
+static int find_bfs(struct find_args *args, char *const *roots, size_t nroots) {
+	struct find_queue queue = {0};
+	args->queue = &queue;
+	int ret = 0;
+	for(size_t i = 0; i < nroots; ++i) {
+		if(find_prepare(args, roots[i]) < 0) {
+			ret = -1;
+		}
+		struct find_task *t;
+		while((t = find_queue_pop(&queue))) {
+			if(find_task(args, t) < 0) {
+				ret = -1;
+			}
+		}
+	}
+	args->queue = NULL;
+	free(queue.tasks);
+	return ret;
+}
+
+/**
+ *  Visit the entry `name` that appeared in the watched
+ *  directory `dir`, opened as `dir_fd`. A new directory is traversed like any
+ *  other, which watches it and its subdirectories, and finds what was
+ *  created in it before it was watched.
+ */
+static int find_watch_entry(struct find_args *args, const struct watch_dir *dir, int dir_fd, const char *name, int is_dir) {
+	find_path_truncate(&args->path, 0);
+	if(find_path_push(&args->path, dir->path) < 0) {
+		find_error(args, "read directory");
+		return -1;
+	}
+	struct dir_chain parent = {
+		.name = dir->path,
+		.dir_fd = AT_FDCWD,
+		.type = DT_DIR,
+		.path_len = args->path.len,
+		.depth = dir->depth,
+		.parent = NULL,
+		.old_entry = FIND_INDEX_NONE,
+	};
+	if(find_path_push(&args->path, name) < 0) {
+		find_error(args, "read directory");
+		return -1;
+	}
+	struct dir_chain child = {
+		.name = name,
+		.dir_fd = dir_fd,
+		.type = is_dir ? DT_DIR : DT_UNKNOWN,
+		.path_len = args->path.len,
+		.depth = dir->depth + 1,
+		.parent = &parent,
+		.old_entry = FIND_INDEX_NONE,
+	};
+	args->xdev = dir->xdev;
+	find_task_seed(args, NULL);
+	int ret = find(args, &child);
+	if(find_run(args) < 0) {
+		ret = -1;
+	}
+	return ret;
+}
+
+/**
+ *  Wait for entries to appear in the directories watched during the
+ *  traversal, and visit them, for `-watch`. `opts->flush` is called after
+ *  every read(2) of events, so the caller can write out matches right away.
+ *  Only returns if events cannot be read or `flush` fails.
+ */
+static int find_watch(struct find_args *args) {
+	struct watch *w = args->watch;
+	char buf[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+	for(;;) {
+		if(args->opts->flush && args->opts->flush(args->opts->ctx) < 0) {
+			return -1;
+		}
+		ssize_t n = read(w->fd, buf, sizeof(buf));
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			find_message(args, "cannot read events: %s", strerror(errno));
+			return -1;
+		}
+		// Events of one directory tend to come in a row, so we keep it open.
+		int last_wd = -1;
+		int dir_fd = -1;
+		for(char *p = buf; p < buf + n;) {
+			const struct inotify_event *ev = (const struct inotify_event *)p;
+			p += sizeof(*ev) + ev->len;
+			if(ev->mask & IN_Q_OVERFLOW) {
+				find_message(args, "too many events, new files may be missing");
+				continue;
+			}
+			if(ev->mask & IN_IGNORED) {
+				watch_remove(w, ev->wd);
+				continue;
+			}
+			const struct watch_dir *dir = watch_get(w, ev->wd);
+			if(!dir || !ev->len) {
+				continue;
+			}
+			if(ev->wd != last_wd) {
+				if(dir_fd >= 0) {
+					close(dir_fd);
+				}
+				last_wd = ev->wd;
+				dir_fd = openat(AT_FDCWD, dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+			}
+			// The directory is gone already, `IN_IGNORED` follows.
+			if(dir_fd < 0) {
+				continue;
+			}
+			find_watch_entry(args, dir, dir_fd, ev->name, !!(ev->mask & IN_ISDIR));
+		}
+		if(dir_fd >= 0) {
+			close(dir_fd);
+		}
+	}
+}
+
+static uint32_t find_index_flags(const struct find_options *o) {
+	return (o->follow ? INDEX_FOLLOW : 0) | (o->xdev ? INDEX_XDEV : 0);
+}
+
+/**
+ *  Implements `build_index`: traverse `roots` and write every file to the
+ *  index. If it already holds an index built with the same options, it is
+ *  refreshed, see `struct find_index`.
+ */
+static int find_build_index(struct find_args *args, char *const *roots, size_t nroots) {
+	const char *file = args->opts->build_index;
+	struct find_index index;
+	index_writer_init(&index.w);
+	uint32_t flags = find_index_flags(args->opts);
+	// Without a usable previous index everything is read.
+	if(index_open(&index.old, file) == 0 && index.old.header->flags != flags) {
+		index_close(&index.old);
+	}
+	// Directories changed after this point must be read again by the next
+	// refresh, see `find_index_unchanged`.
+	struct timespec built;
+	clock_gettime(CLOCK_REALTIME, &built);
+
+	int ret = 0;
+	args->index = &index;
+	for(size_t i = 0; i < nroots; ++i) {
+		if(find_prepare(args, roots[i]) < 0) {
+			ret = -1;
+		}
+	}
+	args->index = NULL;
+
+	if(index_writer_save(&index.w, file, flags, built.tv_sec, built.tv_nsec) < 0) {
+		find_message(args, "cannot write %s: %s", file, strerror(errno));
+		ret = -1;
+	}
+	index_close(&index.old);
+	index_writer_free(&index.w);
+	return ret;
+}
+
+/**
+ *  Implements `index`: walk the entries of the index like `find` walks the
+ *  file system and visit them. Only the subtrees of `roots` are visited, they
+ *  must have been indexed with the same path. Pruned subtrees and those below
+ *  `maxdepth` are skipped.
+ */
+static int find_query_index(struct find_args *args, char *const *roots, size_t nroots) {
+	const char *file = args->opts->index;
+	struct index idx;
+	if(index_open(&idx, file) < 0) {
+		find_message(args, "cannot open index %s: %s", file, strerror(errno));
+		return -1;
+	}
+	if(idx.header->flags != find_index_flags(args->opts)) {
+		find_message(args, "%s was not built with the same -follow and -xdev", file);
+		index_close(&idx);
+		return -1;
+	}
+
+	// One `struct dir_chain` per depth, the current entry's ancestors are the
+	// elements before it.
+	size_t max_depth = 0;
+	for(size_t i = 0; i < idx.header->nentries; ++i) {
+		if(idx.entries[i].depth > max_depth) {
+			max_depth = idx.entries[i].depth;
+		}
+	}
+	struct dir_chain *chain = calloc(max_depth + 1, sizeof(*chain));
+	if(!chain) {
+		find_message(args, "%s", strerror(errno));
+		index_close(&idx);
+		return -1;
+	}
+
+	int ret = 0;
+	for(size_t i = 0; i < nroots; ++i) {
+		size_t root = find_index_root(&idx, roots[i]);
+		if(root == FIND_INDEX_NONE) {
+			find_message(args, "%s is not in index %s", roots[i], file);
+			ret = -1;
+			continue;
+		}
+		for(size_t j = root; j < idx.entries[root].end; ++j) {
+			const struct index_entry *e = &idx.entries[j];
+			struct dir_chain *parent = e->depth > 0 ? &chain[e->depth - 1] : NULL;
+			find_path_truncate(&args->path, parent ? parent->path_len : 0);
+			if(find_path_push(&args->path, index_name(&idx, e)) < 0) {
+				find_error(args, "read index");
+				ret = -1;
+				break;
+			}
+			chain[e->depth] = (struct dir_chain){
+				.name = index_name(&idx, e),
+				.dir_fd = -1,
+				.type = e->type,
+				.path_len = args->path.len,
+				.depth = e->depth,
+				.parent = parent,
+				.old_entry = FIND_INDEX_NONE,
+			};
+			int prune = find_visit(args, &chain[e->depth], DTTOIF(e->type), 0);
+			if(prune < 0) {
+				ret = -1;
+				goto out;
+			}
+			if(prune || e->depth >= args->maxdepth) {
+				j = e->end - 1;
+			}
+		}
+	}
+out:
+	free(chain);
+	index_close(&idx);
+	return ret;
+}
+
+/**
+ *  Directory file descriptors every thread may hold open: `fd_budget`, or
+ *  what is left of `RLIMIT_NOFILE` after a few for stdio and the tasks that
+ *  wait in the `struct pool` with their file descriptors.
+ */
+static size_t find_fd_budget(const struct find_options *o) {
+	if(o->fd_budget) {
+		return o->fd_budget;
+	}
+	struct rlimit rl;
+	if(getrlimit(RLIMIT_NOFILE, &rl) < 0 || rl.rlim_cur == RLIM_INFINITY) {
+		return 0;
+	}
+	size_t reserved = 8 + (o->threads > 1 ? o->threads * FIND_TASK_QUEUE : 0);
+	size_t budget = rl.rlim_cur > reserved ? (rl.rlim_cur - reserved) / o->threads : 0;
+	return budget < 2 ? 2 : budget;
+}
+
+/**
+ *  The fields `find_stat` needs: the type, and `st_ino` and `st_dev` (which
+ *  statx(2) always returns) for loops and `-xdev`. `stat_fields` add theirs,
+ *  the index stores `st_mtim` of directories, and `exclude_fstypes` looks at
+ *  `stx_mnt_id`.
+ */
+static unsigned find_stat_mask(const struct find_options *o) {
+	return STATX_TYPE | STATX_INO
+		| (o->stat_fields & FIND_STAT_SIZE ? STATX_SIZE : 0)
+		| (o->stat_fields & FIND_STAT_MTIME || o->build_index ? STATX_MTIME : 0)
+		| (o->nexclude_fstypes ? STATX_MNT_ID : 0);
+}
+
+void find_options_init(struct find_options *o) {
+	*o = (struct find_options){
+		.follow = 0,
+		.xdev = 0,
+		.dont_sync = 0,
+		.mindepth = 0,
+		.maxdepth = SIZE_MAX,
+		.threads = 1,
+		.fd_budget = 0,
+		.bfs = 0,
+		.sorted = 0,
+		.inode_order = 0,
+		.io_uring = 0,
+		.watch = 0,
+		.unique = 0,
+		.depth = 0,
+		.exclude_fstypes = NULL,
+		.nexclude_fstypes = 0,
+		.prefetch = 0,
+		.stat_fields = 0,
+		.build_index = NULL,
+		.index = NULL,
+		.stats = NULL,
+		.err = stderr,
+		.err_prefix = NULL,
+		.visit = NULL,
+		.flush = NULL,
+		.ctx = NULL,
+	};
+}
+
+static void find_visited_init(struct find_visited *v) {
+	pthread_mutex_init(&v->lock, NULL);
+	inode_keys_init(&v->set);
+}
+
+static void find_visited_free(struct find_visited *v) {
+	inode_keys_free(&v->set);
+	pthread_mutex_destroy(&v->lock);
+}
+
+/**
+ *  Resolve `exclude_fstypes` to the mounts in `m`, which `args` and the copies
+ *  made of it use from then on. `m` is zeroed if nothing is excluded.
+ */
+static int find_mounts_init(struct find_args *args, struct mounts *m) {
+	const struct find_options *o = args->opts;
+	*m = (struct mounts){0};
+	if(o->nexclude_fstypes == 0) {
+		return 0;
+	}
+	if(mounts_exclude(m, o->exclude_fstypes, o->nexclude_fstypes) < 0) {
+		find_message(args, "cannot read /proc/self/mountinfo: %s", strerror(errno));
+		return -1;
+	}
+	args->excluded = m;
+	return 0;
+}
+
+/**
+ *  The `struct find_args` every thread starts from.
+ */
+static struct find_args find_args_template(const struct find_options *o) {
+	return (struct find_args){
+		.opts = o,
+		.err = o->err,
+		.err_prefix = o->err_prefix,
+		.mindepth = o->mindepth,
+		.maxdepth = o->maxdepth,
+		.xdev = -1,
+		.excluded = NULL,
+		.stat_flags = o->follow ? 0 : AT_SYMLINK_NOFOLLOW,
+		.stat_mask = find_stat_mask(o),
+		.statx_flags = o->dont_sync ? AT_STATX_DONT_SYNC : 0,
+		.no_statx = 0,
+		.sorted = o->sorted,
+		.inode_order = o->inode_order,
+		.stat_all = o->stat_fields != 0,
+		.prestat = NULL,
+		.post_order = o->depth,
+		.io_uring = o->io_uring,
+		.prefetch = NULL,
+		.watch = NULL,
+		.visited = NULL,
+		.stats = NULL,
+		.pool = NULL,
+		.worker = 0,
+		.index = NULL,
+		.fd_budget = find_fd_budget(o),
+		.queue = NULL,
+	};
+}
+
+/**
+ *  Traverse `roots` on the calling thread, for everything but `threads`.
+ *  Building and querying an index always run here.
+ */
+static int find_walk_single(const struct find_options *o, char *const *roots, size_t nroots) {
+	struct find_args args = find_args_template(o);
+	args.stats = o->stats;
+	struct mounts excluded;
+	if(find_mounts_init(&args, &excluded) < 0) {
+		return -1;
+	}
+	if(find_args_init(&args) < 0) {
+		find_message(&args, "%s", strerror(errno));
+		mounts_free(&excluded);
+		return -1;
+	}
+	struct find_visited visited;
+	if(o->unique) {
+		find_visited_init(&visited);
+		args.visited = &visited;
+	}
+	struct watch watch;
+	if(o->watch) {
+		if(watch_init(&watch) < 0) {
+			find_message(&args, "cannot watch: %s", strerror(errno));
+			goto fail_watch;
+		}
+		args.watch = &watch;
+	}
+	struct prefetch prefetch;
+	if(o->prefetch) {
+		if(prefetch_init(&prefetch, o->prefetch, FIND_OPEN_AHEAD) < 0) {
+			find_message(&args, "cannot create threads: %s", strerror(errno));
+			goto fail_prefetch;
+		}
+		args.prefetch = &prefetch;
+	}
+	int ret = 0;
+	if(o->build_index) {
+		ret = find_build_index(&args, roots, nroots);
+	} else if(o->index) {
+		ret = find_query_index(&args, roots, nroots);
+	} else if(o->bfs) {
+		ret = find_bfs(&args, roots, nroots);
+	} else {
+		for(size_t i = 0; i < nroots; ++i) {
+			if(find_prepare(&args, roots[i]) < 0) {
+				ret = -1;
+			}
+		}
+	}
+	if(args.watch && find_watch(&args) < 0) {
+		ret = -1;
+	}
+	find_args_free(&args);
+	if(args.prefetch) {
+		prefetch_destroy(args.prefetch);
+	}
+	if(args.watch) {
+		watch_free(args.watch);
+	}
+	if(args.visited) {
+		find_visited_free(args.visited);
+	}
+	mounts_free(&excluded);
+	return ret;
+
+fail_prefetch:
+	if(args.watch) {
+		watch_free(args.watch);
+	}
+fail_watch:
+	find_args_free(&args);
+	if(args.visited) {
+		find_visited_free(args.visited);
+	}
+	mounts_free(&excluded);
+	return -1;
+}
+
+/**
+ *  Traverse `roots` and call `o->visit` for every file, see
+ *  `struct find_options`. Returns -1 if there was any error, they are
+ *  reported to `o->err` and the traversal continues. Options that cannot be
+ *  combined fail with `EINVAL` before anything is visited, instead of being
+ *  ignored.
+ */
+int find_walk(const struct find_options *o, char *const *roots, size_t nroots) {
+	if(
+		(o->threads > 1 && (o->bfs || o->sorted || o->watch || o->prefetch))
+		|| (o->prefetch && (o->bfs || o->io_uring || o->index))
+		|| (o->depth && (o->bfs || o->watch || o->build_index || o->index))
+	) {
+		errno = EINVAL;
+		return -1;
+	}
+	if(o->threads <= 1 || o->build_index || o->index) {
+		return find_walk_single(o, roots, nroots);
+	}
+
+	// Every thread gets its own `struct find_args`, worker 0 is this thread.
+	struct find_args args = find_args_template(o);
+	struct mounts excluded;
+	if(find_mounts_init(&args, &excluded) < 0) {
+		return -1;
+	}
+	struct pool pool;
+	struct find_worker *workers = calloc(o->threads, sizeof(*workers));
+	if(!workers || pool_init(&pool, o->threads, find_task_run, workers) < 0) {
+		find_message(&args, "cannot create threads: %s", strerror(errno));
+		free(workers);
+		mounts_free(&excluded);
+		return -1;
+	}
+	args.pool = &pool;
+	struct find_visited visited;
+	if(o->unique) {
+		find_visited_init(&visited);
+		args.visited = &visited;
+	}
+	int ret = 0;
+	size_t nworkers;
+	for(nworkers = 0; nworkers < o->threads; ++nworkers) {
+		struct find_worker *w = &workers[nworkers];
+		w->args = args;
+		w->args.worker = nworkers;
+		if(o->stats) {
+			w->args.stats = &w->stats;
+		}
+		if(find_args_init(&w->args) < 0) {
+			find_message(&args, "%s", strerror(errno));
+			ret = -1;
+			goto out;
+		}
+	}
+	if(pool_start(&pool) < 0) {
+		// We continue with the threads we have.
+		find_message(&args, "cannot create threads: %s", strerror(errno));
+	}
+
+	for(size_t i = 0; i < nroots; ++i) {
+		if(find_prepare(&workers[0].args, roots[i]) < 0) {
+			ret = -1;
+		}
+	}
+	pool_finish(&pool);
+out:
+	for(size_t i = 0; i < nworkers; ++i) {
+		if(workers[i].ret < 0) {
+			ret = -1;
+		}
+		find_args_free(&workers[i].args);
+		if(o->stats) {
+			stats_merge(o->stats, &workers[i].stats);
+		}
+	}
+	pool_destroy(&pool);
+	free(workers);
+	if(args.visited) {
+		find_visited_free(args.visited);
+	}
+	mounts_free(&excluded);
+	return ret;
+}
+
+/**
+ *  State of a pull-style traversal, see `find_iter_next`. The roots are
+ *  traversed one after the other, `root` is the current one. `pending` is the
+ *  entry returned last, which `find_iter_next` descends into before it looks
+ *  for the next one, unless `prune` was set by `find_iter_prune`. `ret` is -1
+ *  once there was an error.
+ */
+struct find_iter {
+	struct find_options o;
+	struct find_args args;
+	char *const *roots;
+	size_t nroots;
+	size_t next_root;
+	struct dir_chain root;
+	struct dir_chain *pending;
+	int prune;
+	struct find_visit visit;
+	struct find_entry entry;
+	struct find_visited visited;
+	struct mounts excluded;
+	int ret;
+};
+
+/**
+ *  Start a traversal of `roots` whose files are returned one at a time by
+ *  `find_iter_next`, on the calling thread, with `o` like `find_walk`, except
+ *  that `visit` and `flush` are not used. `threads`, `bfs`, `watch`, `depth`,
+ *  `prefetch` and the index are not supported and fail with `EINVAL`.
+ *  `roots` must stay valid until `find_iter_close`.
+ */
+struct find_iter *find_iter_open(const struct find_options *o, char *const *roots, size_t nroots) {
+	if(o->threads > 1 || o->bfs || o->watch || o->depth || o->prefetch || o->build_index || o->index) {
+		errno = EINVAL;
+		return NULL;
+	}
+	struct find_iter *it = malloc(sizeof(*it));
+	if(!it) {
+		return NULL;
+	}
+	*it = (struct find_iter){
+		.o = *o,
+		.roots = roots,
+		.nroots = nroots,
+		.next_root = 0,
+		.pending = NULL,
+		.ret = 0,
+	};
+	it->args = find_args_template(&it->o);
+	it->args.stats = o->stats;
+	if(find_mounts_init(&it->args, &it->excluded) < 0) {
+		free(it);
+		return NULL;
+	}
+	if(find_args_init(&it->args) < 0) {
+		mounts_free(&it->excluded);
+		free(it);
+		return NULL;
+	}
+	find_visited_init(&it->visited);
+	if(o->unique) {
+		it->args.visited = &it->visited;
+	}
+	return it;
+}
+
+/**
+ *  Do not descend into the directory returned last by `find_iter_next`.
+ */
+void find_iter_prune(struct find_iter *it) {
+	it->prune = 1;
+}
+
+/**
+ *  Return the next file, or `NULL` when all roots are done. This is
+ *  `find_run` turned inside out: the entry returned last is descended into
+ *  first, then frames are popped and read until there is a file to return.
+ *  Errors are reported to `err` and skipped.
+ */
+const struct find_entry *find_iter_next(struct find_iter *it) {
+	struct find_args *args = &it->args;
+	if(it->pending) {
+		struct find_batch_entry *pre = args->prestat;
+		if(find_descend(args, it->pending, it->prune) < 0) {
+			it->ret = -1;
+		}
+		if(pre) {
+			find_batch_close(args, pre);
+		}
+		it->pending = NULL;
+	}
+	for(;;) {
+		struct dir_chain *this = find_next(args, &it->ret);
+		if(!this) {
+			if(it->next_root >= it->nroots) {
+				return NULL;
+			}
+			int ret = find_root(args, it->roots[it->next_root++], &it->root);
+			if(ret != 0) {
+				if(ret < 0) {
+					it->ret = -1;
+				}
+				continue;
+			}
+			this = &it->root;
+		}
+		struct find_batch_entry *pre = args->prestat;
+		int visit = find_enter(args, this);
+		if(visit > 0 && this->depth >= args->mindepth) {
+			it->visit = (struct find_visit){
+				.args = args,
+				.this = this,
+				.can_stat = 1,
+			};
+			find_entry_init(args, this, args->st.st_mode, &it->visit, &it->entry);
+			it->pending = this;
+			it->prune = 0;
+			return &it->entry;
+		}
+		if(visit < 0) {
+			args->prestat = NULL;
+			it->ret = -1;
+		} else if(find_descend(args, this, 0) < 0) {
+			it->ret = -1;
+		}
+		if(pre) {
+			find_batch_close(args, pre);
+		}
+	}
+}
+
+/**
+ *  Stop the traversal and free the iterator. Returns -1 if there was any
+ *  error.
+ */
+int find_iter_close(struct find_iter *it) {
+	struct find_args *args = &it->args;
+	// Pop what is left, the errors of an abandoned traversal do not count.
+	if(args->prestat) {
+		find_batch_close(args, args->prestat);
+		args->prestat = NULL;
+	}
+	while(args->top) {
+		find_frame_pop(args, 0);
+	}
+	find_args_free(args);
+	find_visited_free(&it->visited);
+	mounts_free(&it->excluded);
+	int ret = it->ret;
+	free(it);
+	return ret;
+}
@@ -0,0 +1,158 @@
+#ifndef LIBFIND_H
+#define LIBFIND_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include "stats.h"
+
+/**
+ *  The traversal of `find` as a library. Files are handed to the caller as
+ *  `struct find_entry`, either pushed to a visitor by `find_walk`, or pulled
+ *  one at a time with `find_iter_next`. Nothing is formatted or printed,
+ *  except errors to `err`.
+ */
+
+/**
+ *  `find_entry_stat` fields the caller wants filled in besides the type, see
+ *  `stat_fields`.
+ */
+#define FIND_STAT_SIZE 1
+#define FIND_STAT_MTIME 2
+#define FIND_STAT_INO 4
+
+/**
+ *  What a visitor returns, or -1 on an error it reported: `FIND_PRUNE` does
+ *  not descend into the directory, `FIND_MATCH` counts the file as a match
+ *  for `-stats`.
+ */
+#define FIND_CONTINUE 0
+#define FIND_PRUNE 1
+#define FIND_MATCH 2
+
+/**
+ *  A file found by the traversal, valid until the visitor returns or the next
+ *  `find_iter_next`.
+ *
+ *  `path`        the path, starting with the root it was found under
+ *  `name`        offset of the last component in `path`
+ *  `root`        set for the roots themselves, their `path` is the root as
+ *                given and may end with '/'
+ *  `type`        the type as `d_type`, of the target with `follow`
+ *  `depth`       0 for roots
+ *  `worker`      index of the thread that found it, below `threads`
+ */
+struct find_entry {
+	const char *path;
+	size_t path_len;
+	size_t name;
+	int root;
+	unsigned char type;
+	size_t depth;
+	size_t worker;
+	void *priv;
+};
+
+/**
+ *  How to traverse, `find_options_init` sets the defaults. `find_walk` fails
+ *  with `EINVAL` for combinations it does not support, as noted below, instead
+ *  of ignoring one of them.
+ *
+ *  `follow`      report and descend into the targets of symlinks
+ *  `xdev`        do not descend into other file systems
+ *  `dont_sync`   let network file systems answer stat(2) from their cache
+ *  `mindepth`    files above this depth are not visited
+ *  `maxdepth`    directories at this depth are not descended into
+ *  `threads`     visit with this many threads, the visitor is called
+ *                concurrently then
+ *  `fd_budget`   directories kept open per thread, 0 for what
+ *                `RLIMIT_NOFILE` allows
+ *  `bfs`         visit breadth-first; not with `threads`
+ *  `sorted`      visit every directory's entries sorted by name; not with
+ *                `threads`
+ *  `inode_order` stat(2) entries in batches sorted by inode
+ *  `io_uring`    stat(2) and open batches with io_uring(7)
+ *  `watch`       after the traversal, wait for new files and visit them,
+ *                `find_walk` does not return then; not with `threads`
+ *  `unique`      descend into every directory only once, even if it is
+ *                reached again through symlinks or bind mounts
+ *  `exclude_fstypes` `nexclude_fstypes` file system types like `proc` or
+ *                `fuse` (and its subtypes like `fuse.sshfs`) whose mounts are
+ *                visited but not descended into, the mounts are looked up in
+ *                /proc/self/mountinfo once when the traversal starts
+ *  `prefetch`    helper threads that open directories and read their first
+ *                entries ahead of the traversal, 0 for none; the visitor is
+ *                still called on one thread in the same order; not with
+ *                `threads`, `bfs`, `io_uring` or the index
+ *  `depth`       visit directories after everything in them, with
+ *                `threads` once all threads are done below them, and ignore
+ *                `FIND_PRUNE`; not with `bfs`, `watch`, `build_index` or
+ *                the index
+ *  `stat_fields` `FIND_STAT_*` the visitor calls `find_entry_stat` for, files
+ *                are only stat(2)ed when it is called unless it is 0
+ *  `build_index` write every file to this index instead of visiting them
+ *  `index`       visit the files in this index instead of the file system,
+ *                `find_entry_stat`, `find_entry_open` and
+ *                `find_entry_unlink` fail with `ENOTSUP`
+ *  `stats`       if `stats != NULL` the counters of all threads are added to
+ *                it
+ *  `err`         if `err != NULL` errors are written to it
+ *  `err_prefix`  prefix of error messages
+ *  `visit`       called by `find_walk` for every file
+ *  `flush`       if `flush != NULL` called by `watch` after every batch of
+ *                new files, returning -1 stops waiting
+ *  `ctx`         passed to `visit` and `flush`
+ */
+struct find_options {
+	int follow;
+	int xdev;
+	int dont_sync;
+	size_t mindepth;
+	size_t maxdepth;
+	size_t threads;
+	size_t fd_budget;
+	int bfs;
+	int sorted;
+	int inode_order;
+	int io_uring;
+	int watch;
+	int unique;
+	char *const *exclude_fstypes;
+	size_t nexclude_fstypes;
+	size_t prefetch;
+	int depth;
+	unsigned stat_fields;
+	const char *build_index;
+	const char *index;
+	struct stats *stats;
+	FILE *err;
+	const char *err_prefix;
+	int (*visit)(void *ctx, const struct find_entry *e);
+	int (*flush)(void *ctx);
+	void *ctx;
+};
+
+void find_options_init(struct find_options *o);
+
+int find_walk(const struct find_options *o, char *const *roots, size_t nroots);
+
+const struct stat *find_entry_stat(const struct find_entry *e);
+
+int find_entry_open(const struct find_entry *e, int flags);
+
+int find_entry_unlink(const struct find_entry *e);
+
+struct stats *find_entry_stats(const struct find_entry *e);
+
+struct find_iter;
+
+struct find_iter *find_iter_open(const struct find_options *o, char *const *roots, size_t nroots);
+
+const struct find_entry *find_iter_next(struct find_iter *it);
+
+void find_iter_prune(struct find_iter *it);
+
+int find_iter_close(struct find_iter *it);
+
+#endif
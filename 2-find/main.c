@@ -1,85 +1,176 @@
-#define _POSIX_C_SOURCE 200809L  // fdopendir, fstatat
-#define _GNU_SOURCE  // strndupa
-#include <assert.h>
-#include <dirent.h>
+#define _GNU_SOURCE  // DTTOIF
+#include <dirent.h>  // DT_*
 #include <errno.h>
-#include <fcntl.h>  // AT_SYMLINK_NOFOLLOW
-#include <fnmatch.h>
+#include <fcntl.h>  // O_*
+#include <limits.h>  // ULONG_MAX
+#include <pthread.h>
 #include <stdlib.h>  // EXIT_*
+#include <stdint.h>  // SIZE_MAX
 #include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
-// name ist stolen from busybox
-#define DOT_OR_DOTDOT(x) ((x)[0] == '.' && ((x)[1] == '\0' || ((x)[1] == '.' && (x)[2] == '\0')))
+#include "expr.h"
+#include "libfind.h"
+#include "output.h"
+#include "stats.h"
 
 struct cmd_args {
-	const char *name;
-	mode_t mode;
-	int stat_flags;
+	struct expr *expr;
+	size_t mindepth;
+	size_t maxdepth;
+	int follow;
+	int dont_sync;
 	int xdev;
+	size_t threads;
+	size_t jobs;
+	const char *build_index;
+	const char *index;
+	size_t fd_budget;
+	int bfs;
+	int sorted;
+	int inode_order;
+	int io_uring;
+	size_t prefetch;
+	int watch;
+	int unique;
+	char **exclude_fstypes;
+	size_t nexclude_fstypes;
+	int depth;
+	int stats;
 };
 
-_Static_assert(
-	S_IFMT != (mode_t)-1,
-	"We use (mode_t)-1 as a special value, so it must not be a valid file type."
-);
+/**
+ *  Parse the argument `s` of `opt` as a number in [`min`, `max`].
+ */
+static int parse_count(const char *prog, const char *opt, const char *s, unsigned long min, unsigned long max, size_t *n) {
+	char *end;
+	errno = 0;
+	unsigned long v = strtoul(s, &end, 10);
+	if(errno || end == s || *end != '\0' || v < min || v > max || s[0] == '-') {
+		fprintf(stderr, "%s: invalid %s: %s\n", prog, opt, s);
+		return -1;
+	}
+	*n = v;
+	return 0;
+}
 
 /**
  *  Parse arguments and reorder argv so that positional arguments start at the
- *  returned index.
+ *  returned index. Options may appear anywhere, the tokens of the expression
+ *  are collected in order and parsed by `expr_parse`.
  */
 static int parse_args(struct cmd_args *args, int argc, char **argv) {
 	*args = (struct cmd_args){
-		.name = NULL,
-		.mode = -1,
-		.stat_flags = AT_SYMLINK_NOFOLLOW,
+		.expr = NULL,
+		.mindepth = 0,
+		.maxdepth = SIZE_MAX,
+		.follow = 0,
+		.dont_sync = 0,
 		.xdev = 0,
+		.threads = 1,
+		.jobs = 1,
+		.build_index = NULL,
+		.index = NULL,
+		.fd_budget = 0,
+		.bfs = 0,
+		.sorted = 0,
+		.inode_order = 0,
+		.io_uring = 0,
+		.prefetch = 0,
+		.watch = 0,
+		.unique = 0,
+		.exclude_fstypes = NULL,
+		.nexclude_fstypes = 0,
+		.depth = 0,
+		.stats = 0,
 	};
 
+	char **tokens = malloc(argc * sizeof(*tokens));
+	// every other argument could be an -exclude-fstype TYPE
+	args->exclude_fstypes = malloc((argc / 2 + 1) * sizeof(*args->exclude_fstypes));
+	if(!tokens || !args->exclude_fstypes) {
+		fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+		free(tokens);
+		free(args->exclude_fstypes);
+		return -1;
+	}
+	size_t ntokens = 0;
+	int depth_limited = 0;
+
 	int old_argc = argc;
 	int i = 1;
 	while(i < argc) {
-		if(strcmp(argv[i], "-name") == 0) {
-			++i;
-			if(i >= argc) {
-				fprintf(stderr, "%s: missing argument after -name\n", argv[0]);
-			usage:
-				fprintf(
-					stderr,
-					"Usage: %s [-name NAME] [-type <d|f>] [-follow|-L] [-xdev] [DIR...]\n",
-					argv[0]
-				);
-				return -1;
+		// Options with an argument.
+		const char *opt = argv[i];
+		int has_arg = strcmp(opt, "-threads") == 0 || strcmp(opt, "-fd-budget") == 0
+			|| strcmp(opt, "-maxdepth") == 0 || strcmp(opt, "-mindepth") == 0 || strcmp(opt, "-jobs") == 0
+			|| strcmp(opt, "-build-index") == 0 || strcmp(opt, "-index") == 0
+			|| strcmp(opt, "-exclude-fstype") == 0 || strcmp(opt, "-prefetch") == 0;
+		if(has_arg && i + 1 >= argc) {
+			fprintf(stderr, "%s: missing argument after %s\n", argv[0], opt);
+			goto usage;
+		}
+
+		size_t n = expr_token(&argv[i], argc - i);
+		if(n > 0) {
+			// The expression is parsed as a whole once we have all of it.
+			while(n-- > 0) {
+				tokens[ntokens++] = argv[i++];
+			}
+			continue;
+		} else if(strcmp(opt, "-follow") == 0 || strcmp(opt, "-L") == 0) {
+			args->follow = 1;
+		} else if(strcmp(opt, "-xdev") == 0) {
+			args->xdev = 1;
+		} else if(strcmp(opt, "-dont-sync") == 0) {
+			args->dont_sync = 1;
+		} else if(strcmp(opt, "-threads") == 0) {
+			if(parse_count(argv[0], opt, argv[++i], 1, 1024, &args->threads) < 0) {
+				goto usage;
 			}
-			args->name = argv[i];
-		} else if(strcmp(argv[i], "-type") == 0) {
-			++i;
-			if(i >= argc) {
-				fprintf(stderr, "%s: missing argument after -type\n", argv[0]);
+		} else if(strcmp(opt, "-jobs") == 0) {
+			if(parse_count(argv[0], opt, argv[++i], 1, 1024, &args->jobs) < 0) {
 				goto usage;
 			}
-			if(argv[i][0] != '\0' && argv[i][1] == '\0') {
-				switch(argv[i][0]) {
-				case 'd':
-					args->mode = S_IFDIR;
-					break;
-				case 'f':
-					args->mode = S_IFREG;
-					break;
-				default:
-					goto unsupported_type;
-				}
-			} else {
-			unsupported_type:
-				fprintf(stderr, "%s: unsupported -type: %s\n", argv[0], argv[i]);
+		} else if(strcmp(opt, "-fd-budget") == 0) {
+			// a directory and its parent have to be open at the same time
+			if(parse_count(argv[0], opt, argv[++i], 2, ULONG_MAX, &args->fd_budget) < 0) {
 				goto usage;
 			}
-		} else if(strcmp(argv[i], "-follow") == 0 || strcmp(argv[i], "-L") == 0) {
-			args->stat_flags &= ~AT_SYMLINK_NOFOLLOW;
-		} else if(strcmp(argv[i], "-xdev") == 0) {
-			args->xdev = 1;
+		} else if(strcmp(opt, "-maxdepth") == 0 || strcmp(opt, "-mindepth") == 0) {
+			size_t *depth = opt[2] == 'a' ? &args->maxdepth : &args->mindepth;
+			if(parse_count(argv[0], opt, argv[++i], 0, ULONG_MAX, depth) < 0) {
+				goto usage;
+			}
+			depth_limited = 1;
+		} else if(strcmp(opt, "-bfs") == 0) {
+			args->bfs = 1;
+		} else if(strcmp(opt, "-sorted") == 0) {
+			args->sorted = 1;
+		} else if(strcmp(opt, "-inode-order") == 0) {
+			args->inode_order = 1;
+		} else if(strcmp(opt, "-io-uring") == 0) {
+			args->io_uring = 1;
+		} else if(strcmp(opt, "-prefetch") == 0) {
+			if(parse_count(argv[0], opt, argv[++i], 1, 64, &args->prefetch) < 0) {
+				goto usage;
+			}
+		} else if(strcmp(opt, "-watch") == 0) {
+			args->watch = 1;
+		} else if(strcmp(opt, "-unique") == 0) {
+			args->unique = 1;
+		} else if(strcmp(opt, "-exclude-fstype") == 0) {
+			args->exclude_fstypes[args->nexclude_fstypes++] = argv[++i];
+		} else if(strcmp(opt, "-depth") == 0) {
+			args->depth = 1;
+		} else if(strcmp(opt, "-stats") == 0) {
+			args->stats = 1;
+		} else if(strcmp(opt, "-build-index") == 0) {
+			args->build_index = argv[++i];
+		} else if(strcmp(opt, "-index") == 0) {
+			args->index = argv[++i];
 		} else {
 			// We move positional arguments to the end of argv. argc is
 			// decremented because we do not want to parse the moved argument
@@ -103,332 +194,421 @@ static int parse_args(struct cmd_args *args, int argc, char **argv) {
 		argv[k] = tmp;
 	}
 
-	return argc;
-}
+	if(args->build_index && args->index) {
+		fprintf(stderr, "%s: -build-index and -index cannot be combined\n", argv[0]);
+		goto usage;
+	}
+	// The index is written in depth-first order, `-bfs` runs on one thread.
+	if(args->bfs && (args->build_index || args->index || args->threads > 1)) {
+		fprintf(stderr, "%s: -bfs cannot be used with -threads, -build-index or -index\n", argv[0]);
+		goto usage;
+	}
+	// Other threads and the previous index do not know the order.
+	if(args->sorted && (args->build_index || args->index || args->threads > 1)) {
+		fprintf(stderr, "%s: -sorted cannot be used with -threads, -build-index or -index\n", argv[0]);
+		goto usage;
+	}
+	// New files are reported by the thread waiting for events.
+	if(args->watch && (args->build_index || args->index || args->threads > 1)) {
+		fprintf(stderr, "%s: -watch cannot be used with -threads, -build-index or -index\n", argv[0]);
+		goto usage;
+	}
+	// A refreshed index takes unchanged subtrees from the previous one.
+	if(args->unique && (args->build_index || args->index)) {
+		fprintf(stderr, "%s: -unique cannot be used with -build-index or -index\n", argv[0]);
+		goto usage;
+	}
+	// The helpers serve the one thread that keeps the output order, and they
+	// open directories when they are read, not when `-bfs` gets to them.
+	if(args->prefetch && (args->threads > 1 || args->bfs || args->io_uring || args->index)) {
+		fprintf(stderr, "%s: -prefetch cannot be used with -threads, -bfs, -io-uring or -index\n", argv[0]);
+		goto usage;
+	}
+	// The index does not know where the mounts were.
+	if(args->nexclude_fstypes > 0 && args->index) {
+		fprintf(stderr, "%s: -exclude-fstype cannot be used with -index\n", argv[0]);
+		goto usage;
+	}
+	// The index records every file, the expression is evaluated by `-index`.
+	if(args->build_index && (ntokens > 0 || depth_limited)) {
+		fprintf(stderr, "%s: expressions cannot be used with -build-index\n", argv[0]);
+		goto usage;
+	}
 
-int fnmatch_slash(const char *pattern, const char *string, int flags) {
-	int ret = fnmatch(pattern, string, flags);
-	if(ret != 0) {
-		const char *end = string + strlen(string);
-		// Remove all trailing slashes, except string[0].
-		while(end > string + 1 && end[-1] == '/') {
-			--end;
-		}
-		// Skip until last non-trailing slash.
-		const char *start = memrchr(string, '/', end - string);
-		if(start) {
-			if(start < end - 1) {
-				++start;
-			}
-		} else {
-			start = string;
-		}
-		if(start > string || *end == '/') {
-			// Copy substring on the stack and match again.
-			string = strndupa(start, end - start);
-			ret = fnmatch(pattern, string, flags);
-		}
+	args->expr = expr_parse(tokens, ntokens, argv[0]);
+	if(!args->expr) {
+		goto usage;
 	}
-	return ret;
+	// The index only knows names and file types.
+	if(args->index && expr_stat_fields(args->expr)) {
+		fprintf(stderr, "%s: -size, -mtime, -newer, -grep and -printf %%s, %%T@ or %%i cannot be used with -index\n", argv[0]);
+		expr_free(args->expr);
+		goto usage;
+	}
+	// Like find(1), `-delete` implies `-depth`, a directory is only empty
+	// after its entries.
+	int deletes = expr_has_delete(args->expr);
+	if(deletes) {
+		args->depth = 1;
+	}
+	if(args->depth && (args->bfs || args->watch || args->build_index || args->index)) {
+		fprintf(stderr, "%s: -depth and -delete cannot be used with -bfs, -watch, -build-index or -index\n", argv[0]);
+		expr_free(args->expr);
+		goto usage;
+	}
+	// It would delete what symlinks point to, but not the symlinks.
+	if(deletes && args->follow) {
+		fprintf(stderr, "%s: -delete cannot be used with -follow\n", argv[0]);
+		expr_free(args->expr);
+		goto usage;
+	}
+	free(tokens);
+	return argc;
+
+usage:
+	fprintf(
+		stderr,
+		"Usage: %s [-follow|-L] [-xdev] [-exclude-fstype TYPE] [-dont-sync] [-maxdepth N] [-mindepth N] [-depth] [-threads N] [-jobs N] [-fd-budget N] [-bfs] [-sorted] [-inode-order] [-io-uring] [-prefetch N] [-watch] [-unique] [-stats] [-build-index FILE|-index FILE] [DIR...] [EXPRESSION]\n",
+		argv[0]
+	);
+	free(tokens);
+	free(args->exclude_fstypes);
+	return -1;
 }
 
 /**
- *  We store a linked list of `struct dir_chain` on the stack. Every callee
- *  receives a pointer to the caller's `struct dir_chain` it can traverse (or
- *  use `print_dir_chain`) to get the current path.
+ *  What the command line does with the files `find_walk` visits: evaluate
+ *  `expr` and print to `outs`, one `struct output` per thread.
  *
- *  The callee will receive a `dir_fd` of the parent directory and the `name`
- *  of the current file. It can open it's on directory file descriptors with
- *  `openat(dir_fd, name, ...)`.
+ *  With `-depth` and `-threads` a directory is visited by the thread that
+ *  finishes the last directory below it, while entries below it may still sit
+ *  in the buffers of other threads. Then all threads print to `outs[0]`
+ *  instead, holding `shared`, so records are written in the order they were
+ *  printed.
  */
-struct dir_chain {
-	const char *name;
-	int dir_fd;
-	dev_t dev;
-	ino_t ino;
-	struct dir_chain *parent;
+struct cli {
+	const struct expr *expr;
+	struct output *outs;
+	pthread_mutex_t *shared;
+	const char *prog;
 };
 
 /**
- *  Print chain->parent->...->name, chaing->parent->name, and then chain->name
- *  separated by '/'.
+ *  Context of the `struct expr_file` callbacks.
  */
-static int print_dir_chain(FILE *out, const struct dir_chain *chain) {
-	if(chain) {
-		int ret = print_dir_chain(out, chain->parent);
-		if(ret < 0) {
-			return ret;
-		} else if(ret != 0) {
-			// Return 0 tells us no preceding path element or the preceding
-			// element ended with `/`. Only print `/` if neither is the case.
-			if(fputc('/', out) == EOF) {
-				return -1;
-			}
-		}
-		if(fputs(chain->name, out) == EOF) {
-			return -1;
-		}
-		size_t n = strlen(chain->name);
-		if(n > 0 && chain->name[n - 1] == '/') {
-			// Trailing slash, do not print another slash after it.
-			return 0;
-		}
-		return 1;
-	} else {
-		return 0;
+struct cli_file {
+	struct cli *cli;
+	const struct find_entry *e;
+};
+
+static void cli_write_error(const struct cli *cli, const struct find_entry *e) {
+	struct stats *stats = find_entry_stats(e);
+	if(STATS_ON(stats)) {
+		++stats->errors;
 	}
+	int errbak = errno;
+	flockfile(stderr);
+	fprintf(stderr, "%s: cannot write: %s\n", cli->prog, strerror(errbak));
+	funlockfile(stderr);
+	errno = errbak;
 }
 
 /**
- *  `out`         the file stream to write to
- *  `err`         if `err != NULL` write errors to `err`
- *  `err_prefix`  if `err_prefix` prefix all error messages with `err + ": "`
- *  `search_name` search for name
- *  `mode`        if `mode != -1` only look for `st_mode & S_IFMT == mode`
- *  `xdev`        if `xdev != -1` stop recursing if `st_dev != xdev`
- *  `stat_flags`  passed to fstatat(2) (mainly `AT_SYMLINK_NOFOLLOW`)
+ *  Report an error about `e`, like libfind does for the traversal.
  */
-struct find_args {
-	FILE *out;
-	FILE *err;
-	const char *err_prefix;
-	const char *search_name;
-	mode_t mode;
-	dev_t xdev;
-	int stat_flags;
-	struct stat st;
-};
+static void cli_error(const struct cli *cli, const struct find_entry *e, const char *verb) {
+	struct stats *stats = find_entry_stats(e);
+	if(STATS_ON(stats)) {
+		++stats->errors;
+	}
+	int errbak = errno;
+	flockfile(stderr);
+	fprintf(stderr, "%s: cannot %s %s: %s\n", cli->prog, verb, e->path, strerror(errbak));
+	funlockfile(stderr);
+	errno = errbak;
+}
 
 /**
- *  Print error to `err`.
- *  Format: "${prefix}${prefix+: }cannot ${verb} ${path}: ${strerror}"
+ *  The buffer `e` is printed to, with `shared` held if all threads print to
+ *  the same one. `cli_output_done` releases it.
  */
-static void find_error(
-	FILE *err,
-	const char *prefix,
-	const char *verb,
-	const struct dir_chain *this
-) {
-	if(err) {
+static struct output *cli_output(const struct cli *cli, const struct find_entry *e) {
+	if(cli->shared) {
+		pthread_mutex_lock(cli->shared);
+		return &cli->outs[0];
+	}
+	return &cli->outs[e->worker];
+}
+
+static void cli_output_done(const struct cli *cli) {
+	if(cli->shared) {
 		int errbak = errno;
-		if(prefix) {
-			fprintf(err, "%s: ", prefix);
-		}
-		fprintf(err, "cannot %s ", verb);
-		print_dir_chain(err, this);
-		fprintf(err, ": %s\n", strerror(errbak));
+		pthread_mutex_unlock(cli->shared);
 		errno = errbak;
 	}
 }
 
-/**
- *  Implements find(1).
- *  `args` base arguments, passed on recursively, see `struct find_args`
- *  `this` see `struct dir_chain`
- */
-static int find(struct find_args *args, struct dir_chain *this) {
-	////////////////////////////////////////////////////////////////////
-	// WE MUST NOT USE `args->st` AFTER PASSING IT TO ANOTHER `find`, //
-	// BECAUSE IT WILL BE REUSED.                                     //
-	////////////////////////////////////////////////////////////////////
-
-	// Call stat(2) on the file by directory file descriptor and its name
-	// relative to the file descriptor. ("/proc/self/fd/${dir_fd}/${name}")
-	// Avoids some file system race conditions, but mainly lets us avoid string
-	// manipulation.
-	if(fstatat(this->dir_fd, this->name, &args->st, args->stat_flags) < 0) {
-		// Redo stat(2) if the issue may have been a dangling symlink.
-		if(
-			errno != ENOENT
-			|| (args->stat_flags & AT_SYMLINK_NOFOLLOW)
-			|| fstatat(this->dir_fd, this->name, &args->st, args->stat_flags | AT_SYMLINK_NOFOLLOW) < 0
-		) {
-			find_error(args->err, args->err_prefix, "stat", this);
-			return -1;
-		}
+static const struct stat *cli_file_stat(void *ctx) {
+	return find_entry_stat(((struct cli_file *)ctx)->e);
+}
+
+static int cli_file_print(void *ctx, char terminator) {
+	struct cli_file *f = ctx;
+	struct stats *stats = find_entry_stats(f->e);
+	uint64_t start = STATS_ON(stats) ? stats_now() : 0;
+	// `struct output` keeps lines of different threads from interleaving.
+	int ret = output_line(cli_output(f->cli, f->e), f->e->path, f->e->path_len, terminator);
+	cli_output_done(f->cli);
+	if(STATS_ON(stats)) {
+		stats_time(stats, STATS_OUTPUT, start);
+	}
+	if(ret < 0) {
+		cli_write_error(f->cli, f->e);
+		return -1;
 	}
+	return 0;
+}
 
-	// detect file system loop
-	this->dev = args->st.st_dev;
-	this->ino = args->st.st_ino;
-	for(const struct dir_chain *c = this->parent; c; c = c->parent) {
-		if(c->ino == this->ino && c->dev == this->dev) {
-			if(args->err) {
-				int errbak = errno;
-				if(args->err_prefix) {
-					fprintf(args->err, "%s: ", args->err_prefix);
-				}
-				fputs("file system loop detected: ", args->err);
-				print_dir_chain(args->err, this);
-				fputs(" = ", args->err);
-				print_dir_chain(args->err, c);
-				fputc('\n', args->err);
-				errno = errbak;
-			}
-			return -1;
-		}
+static int cli_file_format(void *ctx, const struct format *fmt) {
+	struct cli_file *f = ctx;
+	const struct find_entry *e = f->e;
+	struct format_file ff = {
+		.path = e->path,
+		.path_len = e->path_len,
+		.name = e->name,
+		.depth = e->depth,
+		.mode = DTTOIF(e->type),
+		.st = NULL,
+	};
+	// Only formats with `%s`, `%T@` or `%i` need stat(2).
+	if(fmt->stat && !(ff.st = find_entry_stat(e))) {
+		return -1;
 	}
+	struct stats *stats = find_entry_stats(e);
+	uint64_t start = STATS_ON(stats) ? stats_now() : 0;
+	int ret = format_write(fmt, cli_output(f->cli, e), &ff);
+	cli_output_done(f->cli);
+	if(STATS_ON(stats)) {
+		stats_time(stats, STATS_OUTPUT, start);
+	}
+	if(ret < 0) {
+		cli_write_error(f->cli, e);
+		return -1;
+	}
+	return 0;
+}
 
-	if(
-		// name does not match
-		(args->search_name && fnmatch_slash(args->search_name, this->name, 0) != 0)
-		// type does not match
-		|| (args->mode != (mode_t)-1 && (args->st.st_mode & S_IFMT) != args->mode)
-	) {
-		// nop
-	} else {
-		// Print path.
-		if(print_dir_chain(args->out, this) < 0 || fputc('\n', args->out) == EOF) {
-			if(args->err) {
-				int errbak = errno;
-				if(args->err_prefix) {
-					fprintf(args->err, "%s: ", args->err_prefix);
-				}
-				fprintf(args->err, "cannot write: %s\n", strerror(errbak));
-				errno = errbak;
-			}
-			return -1;
-		}
+static int cli_file_exec(void *ctx, struct exec_cmd *cmd) {
+	struct cli_file *f = ctx;
+	struct output *out = cli_output(f->cli, f->e);
+	// What we printed so far comes before the command's output.
+	int ret = out->len > 0 ? output_flush(out) : 0;
+	cli_output_done(f->cli);
+	if(ret < 0) {
+		cli_write_error(f->cli, f->e);
+		return -1;
 	}
+	return exec_file(cmd, f->e->path, f->e->name);
+}
 
-	// we cannot recurse into non-directories
-	if(!S_ISDIR(args->st.st_mode)) {
+static int cli_file_grep(void *ctx, const struct grep *g) {
+	struct cli_file *f = ctx;
+	const struct stat *st = find_entry_stat(f->e);
+	if(!st) {
 		return 0;
 	}
-
-	// st_dev changed, so we crossed onto another file system, stop recursion
-	if(args->xdev != (dev_t)-1 && args->st.st_dev != args->xdev) {
+	off_t size = st->st_size;
+	// O_NONBLOCK keeps us from hanging on a FIFO that replaced the file.
+	int fd = find_entry_open(f->e, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+	if(fd < 0) {
+		cli_error(f->cli, f->e, "open");
 		return 0;
 	}
-
-	//////////////////////////////////////////////////////////////
-	// BE VERY CAREFUL ABOUT USING `args->st` AFTER THIS POINT. //
-	//////////////////////////////////////////////////////////////
-
-	// Prepare next element in directory chain for callees.
-	struct dir_chain child = {
-		.parent = this,
-	};
-
-	// Open a new directory file descriptor to access children of the current
-	// directory. We cannot use O_PATH because we later use fdopendir(3).
-	child.dir_fd = openat(this->dir_fd, this->name, O_RDONLY | O_DIRECTORY);
-	if(child.dir_fd < 0) {
-		find_error(args->err, args->err_prefix, "open", this);
-		return -1;
+	int ret = grep_fd(g, fd, size);
+	if(ret < 0) {
+		cli_error(f->cli, f->e, "read");
+		ret = 0;
 	}
+	close(fd);
+	return ret;
+}
 
-	// We must copy the directory file descriptor before passing it to to
-	// fdopendir(3) because it will take posession of it.
-	//
-	// > The fdopendir() function is like opendir(), but returns a
-	// > directory stream for the directory referred to by the open file
-	// > descriptor fd.  After a successful call to fdopendir(), fd is
-	// > used internally by the implementation, and should not otherwise
-	// > be used by the application.
-	// -- https://man7.org/linux/man-pages/man3/opendir.3.html#DESCRIPTION
-	int dup_fd = dup(child.dir_fd);
-	if(dup_fd < 0) {
-		find_error(args->err, args->err_prefix, "duplicate file descriptor to", this);
-		int errbak = errno;
-		close(child.dir_fd);
-		errno = errbak;
-		return -1;
+static int cli_file_delete(void *ctx) {
+	struct cli_file *f = ctx;
+	// Like find(1) we do not try to remove the starting point ".".
+	const char *name = f->e->path + f->e->name;
+	if(f->e->root && name[0] == '.' && (name[1] == '\0' || name[1] == '/')) {
+		return 0;
 	}
-	DIR *d = fdopendir(dup_fd);
-	if(!d) {
-		find_error(args->err, args->err_prefix, "open directory", this);
-		int errbak = errno;
-		close(dup_fd);
-		close(child.dir_fd);
-		errno = errbak;
+	if(find_entry_unlink(f->e) < 0) {
+		cli_error(f->cli, f->e, "delete");
 		return -1;
 	}
+	return 0;
+}
 
-	// iterate over children
-	int ret = 0;
-	for(struct dirent *e; (e = readdir(d));) {
-		// ignore "." and ".."
-		if(DOT_OR_DOTDOT(e->d_name)) {
-			continue;
-		}
-		child.name = e->d_name;
-		// Now `child` will look like this:
-		// (struct dir_chain){
-		//     .name = e->d_name,
-		//     .dir_fd = /* file descriptor to the directory we are iterating */,
-		//     .parent = this,
-		// };
-		if(find(args, &child) < 0) {
-			ret = -1;
-		}
+/**
+ *  Evaluate the expression for `e`, see `struct find_options`.
+ *
+ *  Names in a directory cannot contain '/' and their length is known from the
+ *  path, only roots given on the command line are matched with
+ *  `name_match_slash`.
+ */
+static int cli_visit(void *ctx, const struct find_entry *e) {
+	struct cli *cli = ctx;
+	struct cli_file cf = {
+		.cli = cli,
+		.e = e,
+	};
+	struct expr_file f = {
+		.name = e->root ? e->path : e->path + e->name,
+		.name_len = e->root ? e->path_len : e->path_len - e->name,
+		.root = e->root,
+		.mode = DTTOIF(e->type),
+		.stat = cli_file_stat,
+		.print = cli_file_print,
+		.format = cli_file_format,
+		.exec = cli_file_exec,
+		.grep = cli_file_grep,
+		.delete = cli_file_delete,
+		.ctx = &cf,
+		.prune = 0,
+	};
+	int ret = expr_eval(cli->expr, &f);
+	if(ret < 0) {
+		return -1;
 	}
+	return (f.prune ? FIND_PRUNE : 0) | (ret > 0 ? FIND_MATCH : 0);
+}
 
-	int errbak = errno;
-	if(closedir(d) < 0 || close(child.dir_fd) < 0) {
-		find_error(args->err, args->err_prefix, "close", this);
-		// restore errno if there was a previous error
-		if(ret) {
-			errno = errbak;
-		}
-		ret = -1;
+/**
+ *  Write out what `-watch` found so far.
+ */
+static int cli_flush(void *ctx) {
+	struct cli *cli = ctx;
+	if(output_flush(&cli->outs[0]) < 0) {
+		fprintf(stderr, "%s: cannot write: %s\n", cli->prog, strerror(errno));
+		return -1;
 	}
-	return ret;
+	expr_flush(cli->expr);
+	return 0;
 }
 
 /**
- *  Prepare `struct find_args` and `struct dir_chain` for `find`.
- *  If `cmd->xdev` is set, we also stat `name` to retrieve the expected `dev_t`.
+ *  Run the batches of `-exec ... {} +` that are not full yet, after all output
+ *  was written, and wait for all of them. A batch that failed fails `find`.
  */
-static int find_prepare(const char *argv0, const char *name, const struct cmd_args *cmd) {
-	// We cannot remove trailing / from `name` here, so that `print_dir_chain`
-	// does not print //, because `a` and `a/` might be different paths when
-	// symlinks are involved and the path `/`.
-	struct dir_chain root = {
-		.name = name,
-		.dir_fd = AT_FDCWD,
-		.parent = NULL,
-	};
-	struct find_args args = {
-		.out = stdout,
-		.err = stderr,
-		.err_prefix = argv0,
-		.search_name = cmd->name,
-		.mode = cmd->mode,
-		.xdev = -1,
-		.stat_flags = cmd->stat_flags,
-	};
-	if(cmd->xdev) {
-		if(fstatat(root.dir_fd, root.name, &args.st, args.stat_flags) < 0) {
-			return 1;
-		}
-		assert(args.st.st_dev != args.xdev);  // we use (mode_t)-1 as a special value
-		args.xdev = args.st.st_dev;
+static int find_exec_finish(const struct cmd_args *cmd) {
+	int ret = expr_flush(cmd->expr);
+	if(exec_wait() < 0) {
+		ret = -1;
 	}
-	return find(&args, &root);
+	return ret;
 }
 
 _Static_assert(EXIT_FAILURE != 2, "we use exit(2) for wrong command line usage");
+_Static_assert(
+	EXPR_STAT_SIZE == FIND_STAT_SIZE && EXPR_STAT_MTIME == FIND_STAT_MTIME && EXPR_STAT_INO == FIND_STAT_INO,
+	"expr_stat_fields are passed as stat_fields"
+);
 
 int main(int argc, char **argv) {
-	struct cmd_args args;
-	int optind = parse_args(&args, argc, argv);
+	struct cmd_args cmd;
+	int optind = parse_args(&cmd, argc, argv);
 	if(optind < 0) {
 		return 2;
 	}
 
+	if(exec_init(cmd.jobs) < 0) {
+		fprintf(stderr, "%s: cannot run commands: %s\n", argv[0], strerror(errno));
+		expr_free(cmd.expr);
+		free(cmd.exclude_fstypes);
+		return EXIT_FAILURE;
+	}
+
+	static char *dot[] = {".", NULL};
+	char **roots = optind < argc ? &argv[optind] : dot;
+	size_t nroots = optind < argc ? argc - optind : 1;
+
+	// Every thread prints to its own buffer, they share `out_lock`. With
+	// `-depth` they share one buffer, see `struct cli`.
+	static pthread_mutex_t out_lock = PTHREAD_MUTEX_INITIALIZER;
+	static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+	int shared = cmd.depth && cmd.threads > 1;
+	size_t nbuffers = shared ? 1 : cmd.threads;
+	struct output *outs = calloc(nbuffers, sizeof(*outs));
+	if(!outs) {
+		fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+		expr_free(cmd.expr);
+		free(cmd.exclude_fstypes);
+		return EXIT_FAILURE;
+	}
+	size_t nouts;
+	for(nouts = 0; nouts < nbuffers; ++nouts) {
+		if(output_init(&outs[nouts], STDOUT_FILENO, nbuffers > 1 ? &out_lock : NULL) < 0) {
+			fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+			break;
+		}
+	}
+
+	struct cli cli = {
+		.expr = cmd.expr,
+		.outs = outs,
+		.shared = shared ? &shared_lock : NULL,
+		.prog = argv[0],
+	};
+	// the counters of all threads are added up here
+	struct stats stats = {0};
+	struct find_options o;
+	find_options_init(&o);
+	o.follow = cmd.follow;
+	o.xdev = cmd.xdev;
+	o.dont_sync = cmd.dont_sync;
+	o.mindepth = cmd.mindepth;
+	o.maxdepth = cmd.maxdepth;
+	o.threads = cmd.threads;
+	o.fd_budget = cmd.fd_budget;
+	o.bfs = cmd.bfs;
+	o.sorted = cmd.sorted;
+	o.inode_order = cmd.inode_order;
+	o.io_uring = cmd.io_uring;
+	o.prefetch = cmd.prefetch;
+	o.watch = cmd.watch;
+	o.unique = cmd.unique;
+	o.exclude_fstypes = cmd.exclude_fstypes;
+	o.nexclude_fstypes = cmd.nexclude_fstypes;
+	o.depth = cmd.depth;
+	o.stat_fields = expr_stat_fields(cmd.expr);
+	o.build_index = cmd.build_index;
+	o.index = cmd.index;
+	o.stats = cmd.stats ? &stats : NULL;
+	o.err_prefix = argv[0];
+	o.visit = cli_visit;
+	o.flush = cli_flush;
+	o.ctx = &cli;
+
 	int ret = EXIT_SUCCESS;
-	if(optind < argc) {
-		for(int i = optind; i < argc; ++i) {
-			if(find_prepare(argv[0], argv[i], &args) < 0) {
-				ret = EXIT_FAILURE;
+	if(nouts < nbuffers || find_walk(&o, roots, nroots) < 0) {
+		ret = EXIT_FAILURE;
+	}
+	for(size_t i = 0; i < nouts; ++i) {
+		if(output_flush(&outs[i]) < 0) {
+			fprintf(stderr, "%s: cannot write: %s\n", argv[0], strerror(errno));
+			if(cmd.stats) {
+				++stats.errors;
 			}
-		}
-	} else {
-		if(find_prepare(argv[0], ".", &args) < 0) {
 			ret = EXIT_FAILURE;
 		}
+		output_free(&outs[i]);
 	}
-
+	free(outs);
+	if(find_exec_finish(&cmd) < 0) {
+		ret = EXIT_FAILURE;
+	}
+	if(cmd.stats) {
+		stats_print(&stats, stderr, argv[0]);
+	}
+	expr_free(cmd.expr);
+	free(cmd.exclude_fstypes);
 	return ret;
 }
@@ -0,0 +1,124 @@
+#define _GNU_SOURCE  // getline, makedev
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sysmacros.h>
+
+#include "mounts.h"
+
+/**
+ *  Whether the file system type `fstype`, `len` bytes long, is one of `types`.
+ *  A type also matches its subtypes, so `fuse` excludes `fuse.sshfs`.
+ */
+static int mounts_type_match(const char *fstype, size_t len, char *const *types, size_t ntypes) {
+	for(size_t i = 0; i < ntypes; ++i) {
+		size_t n = strlen(types[i]);
+		if(n <= len && memcmp(fstype, types[i], n) == 0 && (n == len || fstype[n] == '.')) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int mounts_id_cmp(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+static int mounts_dev_cmp(const void *a, const void *b) {
+	dev_t x = *(const dev_t *)a;
+	dev_t y = *(const dev_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+/**
+ *  Fill `m` with the mounts of the file system `types` from
+ *  /proc/self/mountinfo. A line is
+ *
+ *      ID PARENT MAJOR:MINOR ROOT MOUNT-POINT OPTIONS [OPTIONAL...] - TYPE SOURCE SUPER-OPTIONS
+ *
+ *  where the fields escape spaces as `\040`, so the optional fields end at the
+ *  first " - ". Mounts made later are not excluded. Returns -1 with `errno` if
+ *  mountinfo cannot be read.
+ */
+int mounts_exclude(struct mounts *m, char *const *types, size_t ntypes) {
+	*m = (struct mounts){0};
+	FILE *f = fopen("/proc/self/mountinfo", "re");
+	if(!f) {
+		return -1;
+	}
+	size_t cap = 0;
+	char *line = NULL;
+	size_t line_cap = 0;
+	ssize_t len;
+	while((len = getline(&line, &line_cap, f)) > 0) {
+		uint64_t id;
+		unsigned major, minor;
+		const char *sep = strstr(line, " - ");
+		if(!sep || sscanf(line, "%" SCNu64 " %*u %u:%u", &id, &major, &minor) != 3) {
+			continue;
+		}
+		const char *fstype = sep + 3;
+		if(!mounts_type_match(fstype, strcspn(fstype, " \n"), types, ntypes)) {
+			continue;
+		}
+		if(m->n == cap) {
+			cap = cap ? cap * 2 : 16;
+			uint64_t *ids = realloc(m->ids, cap * sizeof(*ids));
+			if(ids) {
+				m->ids = ids;
+			}
+			dev_t *devs = realloc(m->devs, cap * sizeof(*devs));
+			if(devs) {
+				m->devs = devs;
+			}
+			if(!ids || !devs) {
+				goto fail;
+			}
+		}
+		m->ids[m->n] = id;
+		m->devs[m->n] = makedev(major, minor);
+		++m->n;
+	}
+	if(ferror(f)) {
+		goto fail;
+	}
+	free(line);
+	fclose(f);
+	if(m->n > 0) {
+		qsort(m->ids, m->n, sizeof(*m->ids), mounts_id_cmp);
+		qsort(m->devs, m->n, sizeof(*m->devs), mounts_dev_cmp);
+	}
+	return 0;
+
+fail:;
+	int errbak = errno;
+	free(line);
+	fclose(f);
+	mounts_free(m);
+	errno = errbak;
+	return -1;
+}
+
+/**
+ *  Whether a directory on the mount `mnt_id`, or if that is
+ *  `MOUNTS_ID_UNKNOWN` on the device `dev`, was excluded.
+ */
+int mounts_excluded(const struct mounts *m, uint64_t mnt_id, dev_t dev) {
+	if(m->n == 0) {
+		return 0;
+	}
+	if(mnt_id != MOUNTS_ID_UNKNOWN) {
+		return bsearch(&mnt_id, m->ids, m->n, sizeof(*m->ids), mounts_id_cmp) != NULL;
+	}
+	return bsearch(&dev, m->devs, m->n, sizeof(*m->devs), mounts_dev_cmp) != NULL;
+}
+
+void mounts_free(struct mounts *m) {
+	free(m->ids);
+	free(m->devs);
+	*m = (struct mounts){0};
+}
@@ -0,0 +1,33 @@
+#ifndef MOUNTS_H
+#define MOUNTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ *  `mnt_id` of a file whose statx(2) did not return `STATX_MNT_ID`.
+ */
+#define MOUNTS_ID_UNKNOWN UINT64_MAX
+
+/**
+ *  The mounts whose file system type was excluded, read once from
+ *  /proc/self/mountinfo by `mounts_exclude`. `ids` are their mount IDs, which
+ *  statx(2) returns as `stx_mnt_id`, and `devs` their `st_dev`, for kernels
+ *  that do not return it. Both are sorted.
+ *
+ *  A zeroed `struct mounts` excludes nothing.
+ */
+struct mounts {
+	uint64_t *ids;
+	dev_t *devs;
+	size_t n;
+};
+
+int mounts_exclude(struct mounts *m, char *const *types, size_t ntypes);
+
+int mounts_excluded(const struct mounts *m, uint64_t mnt_id, dev_t dev);
+
+void mounts_free(struct mounts *m);
+
+#endif
@@ -0,0 +1,173 @@
+#define _GNU_SOURCE  // memmem, memrchr
+#include <fnmatch.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "name-match.h"
+
+/**
+ *  Compile `pattern`, which must outlive `m`. Returns -1 if memory could not
+ *  be allocated.
+ */
+int name_match_compile(struct name_match *m, const char *pattern) {
+	*m = (struct name_match){
+		.kind = NAME_MATCH_FNMATCH,
+		.pattern = pattern,
+	};
+	size_t n = strlen(pattern);
+	m->buf = malloc(n + 1);
+	if(!m->buf) {
+		return -1;
+	}
+
+	// Split the pattern into literal segments separated by runs of `*`. Up to
+	// two segments and a star at either end are supported.
+	const char *segments[2] = {NULL, NULL};
+	size_t lens[2] = {0, 0};
+	size_t nsegments = 0;
+	int leading_star = 0;
+	int trailing_star = 0;
+	char *out = m->buf;
+	for(const char *p = pattern; *p;) {
+		if(*p == '*') {
+			while(*p == '*') {
+				++p;
+			}
+			if(nsegments == 0 && out == m->buf) {
+				leading_star = 1;
+			}
+			trailing_star = 1;
+			continue;
+		}
+		if(nsegments == 2) {
+			return 0;  // three segments, use fnmatch
+		}
+		trailing_star = 0;
+		segments[nsegments] = out;
+		while(*p && *p != '*') {
+			if(*p == '?' || *p == '[') {
+				return 0;  // use fnmatch
+			} else if(*p == '\\') {
+				++p;
+				if(!*p) {
+					return 0;  // trailing backslash, leave it to fnmatch
+				}
+			}
+			*out++ = *p++;
+		}
+		lens[nsegments] = out - segments[nsegments];
+		++nsegments;
+	}
+	*out = '\0';
+
+	if(nsegments == 0) {
+		m->kind = leading_star ? NAME_MATCH_ANY : NAME_MATCH_EXACT;
+		m->prefix = m->buf;
+		return 0;
+	}
+	if(nsegments == 2) {
+		// `a*b`, `*a*b` and `a*b*` need a real matcher
+		if(leading_star || trailing_star) {
+			return 0;
+		}
+		m->kind = NAME_MATCH_AFFIX;
+		m->prefix = segments[0];
+		m->prefix_len = lens[0];
+		m->suffix = segments[1];
+		m->suffix_len = lens[1];
+		return 0;
+	}
+	if(leading_star && trailing_star) {
+		m->kind = NAME_MATCH_INFIX;
+		m->prefix = segments[0];
+		m->prefix_len = lens[0];
+	} else if(leading_star) {
+		m->kind = NAME_MATCH_SUFFIX;
+		m->suffix = segments[0];
+		m->suffix_len = lens[0];
+	} else if(trailing_star) {
+		m->kind = NAME_MATCH_PREFIX;
+		m->prefix = segments[0];
+		m->prefix_len = lens[0];
+	} else {
+		m->kind = NAME_MATCH_EXACT;
+		m->prefix = segments[0];
+		m->prefix_len = lens[0];
+	}
+	return 0;
+}
+
+void name_match_free(struct name_match *m) {
+	free(m->buf);
+	m->buf = NULL;
+}
+
+/**
+ *  Match `name` of length `len`, returns 0 on a match and `FNM_NOMATCH`
+ *  otherwise, like `fnmatch(m->pattern, name, 0)`.
+ */
+int name_match(const struct name_match *m, const char *name, size_t len) {
+	int match;
+	switch(m->kind) {
+	case NAME_MATCH_EXACT:
+		match = len == m->prefix_len && memcmp(name, m->prefix, len) == 0;
+		break;
+	case NAME_MATCH_ANY:
+		match = 1;
+		break;
+	case NAME_MATCH_PREFIX:
+		match = len >= m->prefix_len && memcmp(name, m->prefix, m->prefix_len) == 0;
+		break;
+	case NAME_MATCH_SUFFIX:
+		match = len >= m->suffix_len && memcmp(name + len - m->suffix_len, m->suffix, m->suffix_len) == 0;
+		break;
+	case NAME_MATCH_AFFIX:
+		match = len >= m->prefix_len + m->suffix_len
+			&& memcmp(name, m->prefix, m->prefix_len) == 0
+			&& memcmp(name + len - m->suffix_len, m->suffix, m->suffix_len) == 0;
+		break;
+	case NAME_MATCH_INFIX:
+		match = memmem(name, len, m->prefix, m->prefix_len) != NULL;
+		break;
+	default:
+		return fnmatch(m->pattern, name, 0);
+	}
+	return match ? 0 : FNM_NOMATCH;
+}
+
+/**
+ *  Like `name_match`, but if `string` does not match, its last path component
+ *  without trailing slashes is matched as well. Only the roots given on the
+ *  command line can contain a slash.
+ */
+int name_match_slash(const struct name_match *m, const char *string) {
+	size_t len = strlen(string);
+	int ret = name_match(m, string, len);
+	if(ret != 0) {
+		const char *end = string + len;
+		// Remove all trailing slashes, except string[0].
+		while(end > string + 1 && end[-1] == '/') {
+			--end;
+		}
+		// Skip until last non-trailing slash.
+		const char *start = memrchr(string, '/', end - string);
+		if(start) {
+			if(start < end - 1) {
+				++start;
+			}
+		} else {
+			start = string;
+		}
+		if(start > string || *end == '/') {
+			// Match the substring again. fnmatch needs it null-terminated,
+			// so copy it on the stack.
+			size_t n = end - start;
+			if(m->kind == NAME_MATCH_FNMATCH) {
+				ret = fnmatch(m->pattern, strndupa(start, n), 0);
+			} else {
+				ret = name_match(m, start, n);
+			}
+		}
+	}
+	return ret;
+}
@@ -0,0 +1,48 @@
+#ifndef NAME_MATCH_H
+#define NAME_MATCH_H
+
+#include <stddef.h>
+
+/**
+ *  A `-name` pattern compiled once by `name_match_compile`. Patterns that only
+ *  consist of literal characters and `*` are matched with `memcmp`/`memmem`,
+ *  everything else (`?`, `[...]`) falls back to `fnmatch(3)`.
+ *
+ *  `NAME_MATCH_EXACT`   `lit`       (`prefix` is `lit`)
+ *  `NAME_MATCH_ANY`     `*`
+ *  `NAME_MATCH_PREFIX`  `prefix*`
+ *  `NAME_MATCH_SUFFIX`  `*suffix`
+ *  `NAME_MATCH_AFFIX`   `prefix*suffix`
+ *  `NAME_MATCH_INFIX`   `*infix*`   (`prefix` is `infix`)
+ *  `NAME_MATCH_FNMATCH` anything else
+ *
+ *  Backslash escapes are resolved into `buf`, which `prefix` and `suffix`
+ *  point into.
+ */
+struct name_match {
+	enum {
+		NAME_MATCH_EXACT,
+		NAME_MATCH_ANY,
+		NAME_MATCH_PREFIX,
+		NAME_MATCH_SUFFIX,
+		NAME_MATCH_AFFIX,
+		NAME_MATCH_INFIX,
+		NAME_MATCH_FNMATCH,
+	} kind;
+	const char *pattern;
+	const char *prefix;
+	size_t prefix_len;
+	const char *suffix;
+	size_t suffix_len;
+	char *buf;
+};
+
+int name_match_compile(struct name_match *m, const char *pattern);
+
+void name_match_free(struct name_match *m);
+
+int name_match(const struct name_match *m, const char *name, size_t len);
+
+int name_match_slash(const struct name_match *m, const char *string);
+
+#endif
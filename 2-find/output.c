@@ -0,0 +1,137 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "output.h"
+
+int output_init(struct output *o, int fd, pthread_mutex_t *lock) {
+	*o = (struct output){
+		.fd = fd,
+		.lock = lock,
+		.line_buffered = isatty(fd),
+		.data = malloc(OUTPUT_BUFFER_SIZE),
+		.len = 0,
+		.cap = OUTPUT_BUFFER_SIZE,
+		.start = 0,
+	};
+	return o->data ? 0 : -1;
+}
+
+/**
+ *  write(2) all of `s` while holding `o->lock`.
+ */
+static int output_write(struct output *o, const char *s, size_t n) {
+	int ret = 0;
+	if(o->lock) {
+		pthread_mutex_lock(o->lock);
+	}
+	while(n > 0) {
+		ssize_t w = write(o->fd, s, n);
+		if(w < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			ret = -1;
+			break;
+		}
+		s += w;
+		n -= w;
+	}
+	if(o->lock) {
+		int errbak = errno;
+		pthread_mutex_unlock(o->lock);
+		errno = errbak;
+	}
+	return ret;
+}
+
+int output_flush(struct output *o) {
+	if(o->len == 0) {
+		return 0;
+	}
+	int ret = output_write(o, o->data, o->len);
+	o->len = 0;
+	o->start = 0;
+	return ret;
+}
+
+/**
+ *  Make room for `n` more bytes of the record that begins at `o->start`. The
+ *  records before it are written, and the buffer grows if the record does not
+ *  fit into it, because we cannot split it into two write(2)s, another thread
+ *  might write in between.
+ */
+static int output_reserve(struct output *o, size_t n) {
+	if(o->len + n <= o->cap) {
+		return 0;
+	}
+	if(o->start > 0) {
+		int ret = output_write(o, o->data, o->start);
+		memmove(o->data, o->data + o->start, o->len - o->start);
+		o->len -= o->start;
+		o->start = 0;
+		if(ret < 0) {
+			return -1;
+		}
+		if(o->len + n <= o->cap) {
+			return 0;
+		}
+	}
+	size_t cap = o->cap * 2;
+	while(cap < o->len + n) {
+		cap *= 2;
+	}
+	char *data = realloc(o->data, cap);
+	if(!data) {
+		return -1;
+	}
+	o->data = data;
+	o->cap = cap;
+	return 0;
+}
+
+/**
+ *  Append `n` bytes of `s` to the current record.
+ */
+int output_add(struct output *o, const char *s, size_t n) {
+	if(output_reserve(o, n) < 0) {
+		return -1;
+	}
+	memcpy(o->data + o->len, s, n);
+	o->len += n;
+	return 0;
+}
+
+/**
+ *  End the current record, the next one begins after it.
+ */
+int output_end(struct output *o) {
+	o->start = o->len;
+	if(o->line_buffered) {
+		return output_flush(o);
+	}
+	return 0;
+}
+
+/**
+ *  Append `s` and `terminator` to the buffer as a record. The buffer only
+ *  ever holds whole lines.
+ */
+int output_line(struct output *o, const char *s, size_t n, char terminator) {
+	if(output_reserve(o, n + 1) < 0) {
+		return -1;
+	}
+	memcpy(o->data + o->len, s, n);
+	o->data[o->len + n] = terminator;
+	o->len += n + 1;
+	return output_end(o);
+}
+
+void output_free(struct output *o) {
+	free(o->data);
+	o->data = NULL;
+	o->len = 0;
+	o->cap = 0;
+}
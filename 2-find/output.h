@@ -0,0 +1,46 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+
+/**
+ *  Buffered output of whole lines to a file descriptor, with an explicit buffer
+ *  instead of a `FILE *`, so a line is a single `memcpy` and many lines are a
+ *  single write(2).
+ *
+ *  Every thread has its own `struct output` for the same `fd`. They share
+ *  `lock`, which is held while writing a buffer, so lines of different threads
+ *  never interleave. With `line_buffered` every line is written immediately,
+ *  like stdio does for terminals.
+ *
+ *  Records that are not a single string, like those of `-printf`, are
+ *  appended piece by piece with `output_add` and ended with `output_end`.
+ *  `start` is where the record being appended begins, only the records before
+ *  it are written when the buffer is full.
+ */
+struct output {
+	int fd;
+	pthread_mutex_t *lock;
+	int line_buffered;
+	char *data;
+	size_t len;
+	size_t cap;
+	size_t start;
+};
+
+int output_init(struct output *o, int fd, pthread_mutex_t *lock);
+
+int output_line(struct output *o, const char *s, size_t n, char terminator);
+
+int output_add(struct output *o, const char *s, size_t n);
+
+int output_end(struct output *o);
+
+int output_flush(struct output *o);
+
+void output_free(struct output *o);
+
+#endif
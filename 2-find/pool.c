@@ -0,0 +1,258 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <stdlib.h>
+
+#include "pool.h"
+
+static int deque_init(struct pool_deque *d) {
+	int err = pthread_mutex_init(&d->lock, NULL);
+	if(err) {
+		errno = err;
+		return -1;
+	}
+	d->tasks = NULL;
+	d->cap = 0;
+	d->top = 0;
+	d->len = 0;
+	return 0;
+}
+
+static void deque_destroy(struct pool_deque *d) {
+	free(d->tasks);
+	pthread_mutex_destroy(&d->lock);
+}
+
+/**
+ *  Append `task` at the bottom, grow the ring buffer if necessary.
+ *  Must be called with `d->lock` held.
+ */
+static int deque_push_locked(struct pool_deque *d, void *task) {
+	if(d->len == d->cap) {
+		size_t cap = d->cap ? d->cap * 2 : 64;
+		void **tasks = malloc(cap * sizeof(*tasks));
+		if(!tasks) {
+			return -1;
+		}
+		// unwrap the ring buffer into the new array
+		for(size_t i = 0; i < d->len; ++i) {
+			tasks[i] = d->tasks[(d->top + i) % d->cap];
+		}
+		free(d->tasks);
+		d->tasks = tasks;
+		d->cap = cap;
+		d->top = 0;
+	}
+	d->tasks[(d->top + d->len) % d->cap] = task;
+	++d->len;
+	return 0;
+}
+
+/**
+ *  Take a task from the bottom (`bottom != 0`, the owner) or the top
+ *  (`bottom == 0`, a thief). Returns `NULL` if `d` is empty.
+ */
+static void *deque_take(struct pool_deque *d, int bottom) {
+	void *task = NULL;
+	pthread_mutex_lock(&d->lock);
+	if(d->len > 0) {
+		--d->len;
+		if(bottom) {
+			task = d->tasks[(d->top + d->len) % d->cap];
+		} else {
+			task = d->tasks[d->top];
+			d->top = (d->top + 1) % d->cap;
+		}
+	}
+	pthread_mutex_unlock(&d->lock);
+	return task;
+}
+
+int pool_init(
+	struct pool *p,
+	size_t n,
+	void (*run)(void *ctx, size_t worker, void *task),
+	void *ctx
+) {
+	*p = (struct pool){
+		.n = n,
+		.run = run,
+		.ctx = ctx,
+	};
+	p->deques = calloc(n, sizeof(*p->deques));
+	p->threads = calloc(n, sizeof(*p->threads));
+	if(!p->deques || !p->threads) {
+		goto fail_alloc;
+	}
+	size_t i;
+	for(i = 0; i < n; ++i) {
+		if(deque_init(&p->deques[i]) < 0) {
+			goto fail_deques;
+		}
+	}
+	int err = pthread_mutex_init(&p->lock, NULL);
+	if(err) {
+		errno = err;
+		goto fail_deques;
+	}
+	err = pthread_cond_init(&p->cond, NULL);
+	if(err) {
+		pthread_mutex_destroy(&p->lock);
+		errno = err;
+		goto fail_deques;
+	}
+	return 0;
+
+fail_deques:
+	while(i-- > 0) {
+		deque_destroy(&p->deques[i]);
+	}
+fail_alloc:
+	free(p->threads);
+	free(p->deques);
+	return -1;
+}
+
+void pool_destroy(struct pool *p) {
+	for(size_t i = 0; i < p->n; ++i) {
+		deque_destroy(&p->deques[i]);
+	}
+	pthread_cond_destroy(&p->cond);
+	pthread_mutex_destroy(&p->lock);
+	free(p->threads);
+	free(p->deques);
+}
+
+/**
+ *  Find a task for `worker`: first its own deque, then steal from the others
+ *  starting at its right neighbour.
+ */
+static void *pool_take(struct pool *p, size_t worker) {
+	void *task = deque_take(&p->deques[worker], 1);
+	for(size_t i = 1; !task && i < p->n; ++i) {
+		task = deque_take(&p->deques[(worker + i) % p->n], 0);
+	}
+	return task;
+}
+
+static void pool_work(struct pool *p, size_t worker) {
+	pthread_mutex_lock(&p->lock);
+	while(1) {
+		size_t pushes = p->pushes;
+		pthread_mutex_unlock(&p->lock);
+
+		void *task = pool_take(p, worker);
+		if(task) {
+			p->run(p->ctx, worker, task);
+			pthread_mutex_lock(&p->lock);
+			if(--p->pending == 0) {
+				pthread_cond_broadcast(&p->cond);
+			}
+			continue;
+		}
+
+		pthread_mutex_lock(&p->lock);
+		if(p->pending == 0) {
+			break;
+		}
+		// Only sleep if nothing was pushed since we looked at the deques.
+		if(p->pushes == pushes) {
+			++p->sleeping;
+			pthread_cond_wait(&p->cond, &p->lock);
+			--p->sleeping;
+		}
+	}
+	pthread_mutex_unlock(&p->lock);
+}
+
+struct pool_thread_arg {
+	struct pool *p;
+	size_t worker;
+};
+
+static void *pool_thread(void *arg) {
+	struct pool_thread_arg a = *(struct pool_thread_arg *)arg;
+	free(arg);
+	pool_work(a.p, a.worker);
+	return NULL;
+}
+
+/**
+ *  Start workers 1..n-1. If a thread cannot be created, -1 is returned, but the
+ *  pool still works with the workers started so far.
+ */
+int pool_start(struct pool *p) {
+	p->pending = 1;
+	size_t started = 1;
+	for(size_t i = 1; i < p->n; ++i) {
+		struct pool_thread_arg *arg = malloc(sizeof(*arg));
+		if(!arg) {
+			break;
+		}
+		*arg = (struct pool_thread_arg){
+			.p = p,
+			.worker = i,
+		};
+		int err = pthread_create(&p->threads[i], NULL, pool_thread, arg);
+		if(err) {
+			free(arg);
+			errno = err;
+			break;
+		}
+		++started;
+	}
+	p->started = started;
+	return started == p->n ? 0 : -1;
+}
+
+/**
+ *  Release the hold taken by `pool_start`, work as worker 0 until every task
+ *  has finished and join the other workers.
+ */
+void pool_finish(struct pool *p) {
+	pthread_mutex_lock(&p->lock);
+	if(--p->pending == 0) {
+		pthread_cond_broadcast(&p->cond);
+	}
+	pthread_mutex_unlock(&p->lock);
+	pool_work(p, 0);
+	for(size_t i = 1; i < p->started; ++i) {
+		pthread_join(p->threads[i], NULL);
+	}
+}
+
+int pool_push(struct pool *p, size_t worker, void *task) {
+	// Count the task as pending before it becomes visible, otherwise a thief
+	// could finish it and drop `pending` to 0 while we are still running.
+	pthread_mutex_lock(&p->lock);
+	++p->pending;
+	pthread_mutex_unlock(&p->lock);
+
+	struct pool_deque *d = &p->deques[worker];
+	pthread_mutex_lock(&d->lock);
+	int ret = deque_push_locked(d, task);
+	pthread_mutex_unlock(&d->lock);
+
+	pthread_mutex_lock(&p->lock);
+	if(ret < 0) {
+		--p->pending;
+		pthread_mutex_unlock(&p->lock);
+		return -1;
+	}
+	++p->pushes;
+	if(p->sleeping) {
+		pthread_cond_signal(&p->cond);
+	}
+	pthread_mutex_unlock(&p->lock);
+	return 0;
+}
+
+/**
+ *  Number of tasks waiting in `worker`'s deque.
+ */
+size_t pool_queued(struct pool *p, size_t worker) {
+	struct pool_deque *d = &p->deques[worker];
+	pthread_mutex_lock(&d->lock);
+	size_t len = d->len;
+	pthread_mutex_unlock(&d->lock);
+	return len;
+}
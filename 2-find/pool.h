@@ -0,0 +1,63 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+/**
+ *  Double-ended queue of tasks. The owning worker pushes and pops at the
+ *  bottom (LIFO, so it stays depth-first and cache-warm), idle workers steal
+ *  from the top (FIFO, so they take the oldest and usually biggest subtrees).
+ */
+struct pool_deque {
+	pthread_mutex_t lock;
+	void **tasks;
+	size_t cap;
+	size_t top;
+	size_t len;
+};
+
+/**
+ *  A fixed set of workers with one `struct pool_deque` each. Worker 0 is the
+ *  thread calling `pool_finish`, workers 1..started-1 are started by
+ *  `pool_start`.
+ *
+ *  `pending` counts pushed tasks that have not finished running yet, plus one
+ *  hold taken by `pool_start` and released by `pool_finish`, so that workers
+ *  do not exit before the caller is done pushing the initial tasks.
+ *  `pushes` is incremented on every push, a worker that wants to sleep uses it
+ *  to detect tasks pushed after it last looked at the deques.
+ */
+struct pool {
+	size_t n;
+	size_t started;
+	struct pool_deque *deques;
+	pthread_t *threads;
+	void (*run)(void *ctx, size_t worker, void *task);
+	void *ctx;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	size_t pending;
+	size_t pushes;
+	size_t sleeping;
+};
+
+int pool_init(
+	struct pool *p,
+	size_t n,
+	void (*run)(void *ctx, size_t worker, void *task),
+	void *ctx
+);
+
+void pool_destroy(struct pool *p);
+
+int pool_start(struct pool *p);
+
+void pool_finish(struct pool *p);
+
+int pool_push(struct pool *p, size_t worker, void *task);
+
+size_t pool_queued(struct pool *p, size_t worker);
+
+#endif
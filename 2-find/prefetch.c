@@ -0,0 +1,229 @@
+#define _GNU_SOURCE  // getdents64
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "prefetch.h"
+
+/**
+ *  Open `r` and read its first batch of entries, without holding the lock.
+ */
+static void prefetch_run(struct prefetch_req *r) {
+	r->len = 0;
+	r->err = 0;
+	r->fd = openat(r->dir_fd, r->name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(r->fd < 0) {
+		r->err = errno;
+		return;
+	}
+	struct dir_buffer *buf = &r->buf;
+	if(!buf->data) {
+		buf->data = malloc(DIR_BUFFER_MIN);
+		if(!buf->data) {
+			return;
+		}
+		buf->size = DIR_BUFFER_MIN;
+	}
+	ssize_t n = getdents64(r->fd, buf->data, buf->size);
+	if(n > 0) {
+		r->len = n;
+	}
+}
+
+static void *prefetch_thread(void *arg) {
+	struct prefetch *p = arg;
+	pthread_mutex_lock(&p->lock);
+	while(!p->stop) {
+		struct prefetch_req *r = p->head;
+		if(!r) {
+			++p->idle;
+			pthread_cond_wait(&p->work, &p->lock);
+			--p->idle;
+			continue;
+		}
+		p->head = r->next;
+		if(!p->head) {
+			p->tail = &p->head;
+		}
+		r->state = PREFETCH_RUNNING;
+		pthread_mutex_unlock(&p->lock);
+		prefetch_run(r);
+		pthread_mutex_lock(&p->lock);
+		r->state = PREFETCH_DONE;
+		if(p->waiting) {
+			pthread_cond_broadcast(&p->done);
+		}
+	}
+	pthread_mutex_unlock(&p->lock);
+	return NULL;
+}
+
+static void prefetch_stop(struct prefetch *p, size_t started) {
+	pthread_mutex_lock(&p->lock);
+	p->stop = 1;
+	pthread_cond_broadcast(&p->work);
+	pthread_mutex_unlock(&p->lock);
+	for(size_t i = 0; i < started; ++i) {
+		pthread_join(p->threads[i], NULL);
+	}
+}
+
+/**
+ *  Start `threads` helpers with `window` requests. Returns -1 with `errno` if
+ *  any of it fails, the helpers started so far are stopped again.
+ */
+int prefetch_init(struct prefetch *p, size_t threads, size_t window) {
+	*p = (struct prefetch){
+		.window = window,
+		.nthreads = threads,
+	};
+	p->tail = &p->head;
+	p->reqs = calloc(window, sizeof(*p->reqs));
+	p->threads = calloc(threads, sizeof(*p->threads));
+	if(!p->reqs || !p->threads) {
+		goto fail_alloc;
+	}
+	for(size_t i = window; i-- > 0;) {
+		p->reqs[i] = (struct prefetch_req){
+			.next = p->free,
+			.state = PREFETCH_FREE,
+			.fd = -1,
+		};
+		p->free = &p->reqs[i];
+	}
+	int err = pthread_mutex_init(&p->lock, NULL);
+	if(err) {
+		goto fail_lock;
+	}
+	err = pthread_cond_init(&p->work, NULL);
+	if(err) {
+		goto fail_work;
+	}
+	err = pthread_cond_init(&p->done, NULL);
+	if(err) {
+		goto fail_done;
+	}
+	for(size_t i = 0; i < threads; ++i) {
+		err = pthread_create(&p->threads[i], NULL, prefetch_thread, p);
+		if(err) {
+			prefetch_stop(p, i);
+			goto fail_threads;
+		}
+	}
+	return 0;
+
+fail_threads:
+	pthread_cond_destroy(&p->done);
+fail_done:
+	pthread_cond_destroy(&p->work);
+fail_work:
+	pthread_mutex_destroy(&p->lock);
+fail_lock:
+	errno = err;
+fail_alloc:
+	free(p->threads);
+	free(p->reqs);
+	return -1;
+}
+
+/**
+ *  Stop the helpers. Every request has to be released already.
+ */
+void prefetch_destroy(struct prefetch *p) {
+	prefetch_stop(p, p->nthreads);
+	for(size_t i = 0; i < p->window; ++i) {
+		dir_buffer_free(&p->reqs[i].buf);
+	}
+	pthread_cond_destroy(&p->done);
+	pthread_cond_destroy(&p->work);
+	pthread_mutex_destroy(&p->lock);
+	free(p->threads);
+	free(p->reqs);
+}
+
+/**
+ *  Queue `name` relative to `dir_fd` for the helpers. Returns `NULL` if all
+ *  `window` requests are taken.
+ */
+struct prefetch_req *prefetch_submit(struct prefetch *p, int dir_fd, const char *name) {
+	pthread_mutex_lock(&p->lock);
+	struct prefetch_req *r = p->free;
+	if(r) {
+		p->free = r->next;
+		r->next = NULL;
+		r->dir_fd = dir_fd;
+		r->name = name;
+		r->state = PREFETCH_QUEUED;
+		*p->tail = r;
+		p->tail = &r->next;
+		if(p->idle) {
+			pthread_cond_signal(&p->work);
+		}
+	}
+	pthread_mutex_unlock(&p->lock);
+	return r;
+}
+
+/**
+ *  Remove the queued `r` from the queue, with the lock held.
+ */
+static void prefetch_unqueue(struct prefetch *p, struct prefetch_req *r) {
+	struct prefetch_req **prev = &p->head;
+	while(*prev != r) {
+		prev = &(*prev)->next;
+	}
+	*prev = r->next;
+	if(p->tail == &r->next) {
+		p->tail = prev;
+	}
+}
+
+/**
+ *  Wait until `r` is done. A request no helper took yet is run by the caller,
+ *  which needs it now, instead of waiting for the ones queued before it.
+ */
+void prefetch_wait(struct prefetch *p, struct prefetch_req *r) {
+	pthread_mutex_lock(&p->lock);
+	if(r->state == PREFETCH_QUEUED) {
+		prefetch_unqueue(p, r);
+		r->state = PREFETCH_RUNNING;
+		pthread_mutex_unlock(&p->lock);
+		prefetch_run(r);
+		pthread_mutex_lock(&p->lock);
+		r->state = PREFETCH_DONE;
+	}
+	while(r->state != PREFETCH_DONE) {
+		++p->waiting;
+		pthread_cond_wait(&p->done, &p->lock);
+		--p->waiting;
+	}
+	pthread_mutex_unlock(&p->lock);
+}
+
+/**
+ *  Return `r`, closing its directory unless the caller took `fd` and set it
+ *  to -1. A request that is still queued is dropped without running it, one
+ *  that is running is waited for.
+ */
+void prefetch_release(struct prefetch *p, struct prefetch_req *r) {
+	pthread_mutex_lock(&p->lock);
+	if(r->state == PREFETCH_QUEUED) {
+		prefetch_unqueue(p, r);
+		r->fd = -1;
+	}
+	while(r->state == PREFETCH_RUNNING) {
+		++p->waiting;
+		pthread_cond_wait(&p->done, &p->lock);
+		--p->waiting;
+	}
+	if(r->fd >= 0) {
+		close(r->fd);
+		r->fd = -1;
+	}
+	r->state = PREFETCH_FREE;
+	r->next = p->free;
+	p->free = r;
+	pthread_mutex_unlock(&p->lock);
+}
@@ -0,0 +1,72 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "dir-reader.h"
+
+enum prefetch_state {
+	PREFETCH_FREE,
+	PREFETCH_QUEUED,
+	PREFETCH_RUNNING,
+	PREFETCH_DONE,
+};
+
+/**
+ *  A directory `name` relative to `dir_fd` to open and read ahead. Once it is
+ *  `PREFETCH_DONE`, `fd` is the open directory, or -1 with `err`, and `buf`
+ *  holds its first getdents64(2) batch of `len` bytes. `len` is 0 if reading
+ *  failed, the caller reads again and gets the error itself then. `name` and
+ *  `dir_fd` have to stay valid until it is done.
+ */
+struct prefetch_req {
+	struct prefetch_req *next;
+	int dir_fd;
+	const char *name;
+	enum prefetch_state state;
+	int fd;
+	int err;
+	size_t len;
+	struct dir_buffer buf;
+};
+
+/**
+ *  Helper threads that open directories and read their first batch of
+ *  entries while the caller is busy with other ones, so their latency
+ *  overlaps, see `-prefetch`. There are `window` requests, a caller that took
+ *  all of them has to wait for one before it can look further ahead. Queued
+ *  requests are run first in, first out, from `head` to `tail`, free ones are
+ *  on the `free` list. `lock` protects all of it, `work` wakes the helpers and
+ *  `done` the caller. They are only signalled if `idle` helpers or a
+ *  `waiting` caller sleep on them, which saves a futex(2) per request when
+ *  everybody is busy.
+ */
+struct prefetch {
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t done;
+	struct prefetch_req *reqs;
+	size_t window;
+	struct prefetch_req *free;
+	struct prefetch_req *head;
+	struct prefetch_req **tail;
+	pthread_t *threads;
+	size_t nthreads;
+	size_t idle;
+	size_t waiting;
+	int stop;
+};
+
+int prefetch_init(struct prefetch *p, size_t threads, size_t window);
+
+void prefetch_destroy(struct prefetch *p);
+
+struct prefetch_req *prefetch_submit(struct prefetch *p, int dir_fd, const char *name);
+
+void prefetch_wait(struct prefetch *p, struct prefetch_req *r);
+
+void prefetch_release(struct prefetch *p, struct prefetch_req *r);
+
+#endif
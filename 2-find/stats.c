@@ -0,0 +1,91 @@
+#define _POSIX_C_SOURCE 200809L  // clock_gettime
+#include <inttypes.h>
+
+#include "stats.h"
+
+/**
+ *  Record that `op` took from `start` until now.
+ */
+void stats_time(struct stats *s, enum stats_op op, uint64_t start) {
+	uint64_t ns = stats_now() - start;
+	struct stats_latency *l = &s->ops[op];
+	++l->count;
+	l->total += ns;
+	if(ns > l->max) {
+		l->max = ns;
+	}
+	size_t bucket = 0;
+	while(bucket + 1 < STATS_BUCKETS && ns >> (bucket + 1)) {
+		++bucket;
+	}
+	++l->buckets[bucket];
+}
+
+void stats_merge(struct stats *dst, const struct stats *src) {
+	dst->entries += src->entries;
+	dst->stats_skipped += src->stats_skipped;
+	dst->dirs_seen += src->dirs_seen;
+	dst->matches += src->matches;
+	dst->errors += src->errors;
+	for(size_t i = 0; i < STATS_OPS; ++i) {
+		struct stats_latency *d = &dst->ops[i];
+		const struct stats_latency *s = &src->ops[i];
+		d->count += s->count;
+		d->total += s->total;
+		if(s->max > d->max) {
+			d->max = s->max;
+		}
+		for(size_t j = 0; j < STATS_BUCKETS; ++j) {
+			d->buckets[j] += s->buckets[j];
+		}
+	}
+}
+
+/**
+ *  Print `ns` with a unit that keeps it short.
+ */
+static void stats_print_ns(FILE *f, uint64_t ns) {
+	if(ns < 10000) {
+		fprintf(f, "%" PRIu64 "ns", ns);
+	} else if(ns < 10000000) {
+		fprintf(f, "%" PRIu64 "us", ns / 1000);
+	} else {
+		fprintf(f, "%" PRIu64 "ms", ns / 1000000);
+	}
+}
+
+/**
+ *  Print the report of `-stats`, every line prefixed with `prefix`. Buckets of
+ *  the histograms are printed as their lower bound and only if not empty.
+ */
+void stats_print(const struct stats *s, FILE *f, const char *prefix) {
+	static const char *const names[STATS_OPS] = {
+		[STATS_OPEN] = "open",
+		[STATS_GETDENTS] = "getdents",
+		[STATS_STAT] = "stat",
+		[STATS_MATCH] = "match",
+		[STATS_OUTPUT] = "output",
+	};
+	fprintf(f, "%s: directories opened: %" PRIu64 "\n", prefix, s->ops[STATS_OPEN].count);
+	fprintf(f, "%s: entries read: %" PRIu64 "\n", prefix, s->entries);
+	fprintf(f, "%s: stats issued: %" PRIu64 "\n", prefix, s->ops[STATS_STAT].count);
+	fprintf(f, "%s: stats skipped: %" PRIu64 "\n", prefix, s->stats_skipped);
+	fprintf(f, "%s: directories seen before: %" PRIu64 "\n", prefix, s->dirs_seen);
+	fprintf(f, "%s: matches: %" PRIu64 "\n", prefix, s->matches);
+	fprintf(f, "%s: errors: %" PRIu64 "\n", prefix, s->errors);
+	for(size_t i = 0; i < STATS_OPS; ++i) {
+		const struct stats_latency *l = &s->ops[i];
+		fprintf(f, "%s: %s: %" PRIu64 " calls, total ", prefix, names[i], l->count);
+		stats_print_ns(f, l->total);
+		fputs(", max ", f);
+		stats_print_ns(f, l->max);
+		for(size_t j = 0; j < STATS_BUCKETS; ++j) {
+			if(l->buckets[j]) {
+				fputs(j == 0 ? ", >=" : " >=", f);
+				stats_print_ns(f, j == 0 ? 0 : (uint64_t)1 << j);
+				fprintf(f, ":%" PRIu64, l->buckets[j]);
+			}
+		}
+		fputc('\n', f);
+	}
+}
@@ -0,0 +1,66 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/**
+ *  Latency histograms have one bucket per power of two nanoseconds, bucket
+ *  `i` counts durations in [2^i, 2^(i+1)) ns, the last one everything longer.
+ */
+#define STATS_BUCKETS 40
+
+/**
+ *  The kinds of operations that are timed. `STATS_MATCH` is the whole
+ *  expression, including lazy stat(2)s and actions, which are also counted on
+ *  their own.
+ */
+enum stats_op {
+	STATS_OPEN,
+	STATS_GETDENTS,
+	STATS_STAT,
+	STATS_MATCH,
+	STATS_OUTPUT,
+	STATS_OPS,
+};
+
+struct stats_latency {
+	uint64_t count;
+	uint64_t total;
+	uint64_t max;
+	uint64_t buckets[STATS_BUCKETS];
+};
+
+/**
+ *  Counters of one thread for `-stats`, merged with `stats_merge` at exit.
+ *  Directories opened and stat(2)s issued are the counts of their latencies.
+ */
+struct stats {
+	uint64_t entries;
+	uint64_t stats_skipped;
+	uint64_t dirs_seen;
+	uint64_t matches;
+	uint64_t errors;
+	struct stats_latency ops[STATS_OPS];
+};
+
+/**
+ *  Whether `-stats` is on. Callers guard every measurement with it, the
+ *  branch is predicted not taken, so there is no cost without `-stats`.
+ */
+#define STATS_ON(stats) __builtin_expect((stats) != NULL, 0)
+
+static inline uint64_t stats_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void stats_time(struct stats *s, enum stats_op op, uint64_t start);
+
+void stats_merge(struct stats *dst, const struct stats *src);
+
+void stats_print(const struct stats *s, FILE *f, const char *prefix);
+
+#endif
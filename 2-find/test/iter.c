@@ -0,0 +1,187 @@
+#define _DEFAULT_SOURCE  // DT_DIR, strdup
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../libfind.h"
+
+/**
+ *  Usage: iter [-prune NAME] [-stop N] DIR
+ *
+ *  Prints the files `find_iter_next` returns for `DIR`, not descending into
+ *  directories called `NAME`, and checks that `find_walk` visits the same
+ *  ones. With `-stop N` it calls `find_iter_close` after `N` files instead
+ *  and checks that no directory was left open. Both refuse options they
+ *  cannot combine.
+ */
+
+struct paths {
+	char **paths;
+	size_t n;
+	size_t cap;
+};
+
+static int paths_add(struct paths *p, const char *path) {
+	if(p->n == p->cap) {
+		size_t cap = p->cap ? p->cap * 2 : 64;
+		char **paths = realloc(p->paths, cap * sizeof(*paths));
+		if(!paths) {
+			return -1;
+		}
+		p->paths = paths;
+		p->cap = cap;
+	}
+	if(!(p->paths[p->n] = strdup(path))) {
+		return -1;
+	}
+	++p->n;
+	return 0;
+}
+
+static int paths_cmp(const void *a, const void *b) {
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void paths_free(struct paths *p) {
+	for(size_t i = 0; i < p->n; ++i) {
+		free(p->paths[i]);
+	}
+	free(p->paths);
+}
+
+struct walk {
+	struct paths paths;
+	const char *prune;
+};
+
+static int is_pruned(const struct find_entry *e, const char *prune) {
+	return prune && e->type == DT_DIR && strcmp(e->path + e->name, prune) == 0;
+}
+
+static int walk_visit(void *ctx, const struct find_entry *e) {
+	struct walk *w = ctx;
+	if(paths_add(&w->paths, e->path) < 0) {
+		return -1;
+	}
+	return is_pruned(e, w->prune) ? FIND_PRUNE : FIND_CONTINUE;
+}
+
+/**
+ *  The lowest free file descriptor, which is higher while any directory is
+ *  still open.
+ */
+static int lowest_fd(void) {
+	int fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+	if(fd >= 0) {
+		close(fd);
+	}
+	return fd;
+}
+
+int main(int argc, char **argv) {
+	const char *prune = NULL;
+	long stop = -1;
+	int i = 1;
+	for(; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+		if(strcmp(argv[i], "-prune") == 0) {
+			prune = argv[i + 1];
+		} else if(strcmp(argv[i], "-stop") == 0) {
+			stop = strtol(argv[i + 1], NULL, 10);
+		} else {
+			break;
+		}
+	}
+	if(i + 1 != argc) {
+		fprintf(stderr, "Usage: %s [-prune NAME] [-stop N] DIR\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	char *const *roots = &argv[i];
+
+	struct find_options o;
+	find_options_init(&o);
+	o.err = stderr;
+	o.err_prefix = argv[0];
+
+	int fd_before = lowest_fd();
+	struct find_iter *it = find_iter_open(&o, roots, 1);
+	if(!it) {
+		fprintf(stderr, "%s: cannot start: %s\n", argv[0], strerror(errno));
+		return EXIT_FAILURE;
+	}
+	struct paths got = {0};
+	const struct find_entry *e;
+	long n = 0;
+	while(n != stop && (e = find_iter_next(it))) {
+		if(paths_add(&got, e->path) < 0) {
+			fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+			return EXIT_FAILURE;
+		}
+		if(is_pruned(e, prune)) {
+			find_iter_prune(it);
+		}
+		++n;
+	}
+	int ret = find_iter_close(it) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+	if(stop >= 0) {
+		if(n != stop) {
+			printf("%s: only %ld files\n", argv[0], n);
+			ret = EXIT_FAILURE;
+		} else if(lowest_fd() != fd_before) {
+			printf("%s: directories left open after find_iter_close\n", argv[0]);
+			ret = EXIT_FAILURE;
+		} else {
+			printf("%s: stopped after %ld files\n", argv[0], n);
+		}
+		paths_free(&got);
+		return ret;
+	}
+
+	struct find_options bad = o;
+	bad.threads = 2;
+	bad.bfs = 1;
+	if(find_walk(&bad, roots, 1) == 0 || errno != EINVAL) {
+		printf("%s: find_walk accepted threads with bfs\n", argv[0]);
+		ret = EXIT_FAILURE;
+	}
+	if(find_iter_open(&bad, roots, 1) || errno != EINVAL) {
+		printf("%s: find_iter_open accepted threads with bfs\n", argv[0]);
+		ret = EXIT_FAILURE;
+	}
+
+	struct walk w = {
+		.paths = {0},
+		.prune = prune,
+	};
+	o.visit = walk_visit;
+	o.ctx = &w;
+	if(find_walk(&o, roots, 1) < 0) {
+		ret = EXIT_FAILURE;
+	}
+	for(size_t j = 0; j < got.n; ++j) {
+		printf("%s\n", got.paths[j]);
+	}
+	// Compare the sets, the visitor is not required to see the same order.
+	qsort(got.paths, got.n, sizeof(*got.paths), paths_cmp);
+	qsort(w.paths.paths, w.paths.n, sizeof(*w.paths.paths), paths_cmp);
+	size_t a = 0, b = 0;
+	while(a < got.n || b < w.paths.n) {
+		int cmp = a == got.n ? 1 : b == w.paths.n ? -1 : strcmp(got.paths[a], w.paths.paths[b]);
+		if(cmp < 0) {
+			printf("%s: not visited by find_walk: %s\n", argv[0], got.paths[a++]);
+			ret = EXIT_FAILURE;
+		} else if(cmp > 0) {
+			printf("%s: not returned by find_iter_next: %s\n", argv[0], w.paths.paths[b++]);
+			ret = EXIT_FAILURE;
+		} else {
+			++a;
+			++b;
+		}
+	}
+	paths_free(&got);
+	paths_free(&w.paths);
+	return ret;
+}
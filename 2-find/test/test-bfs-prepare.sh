@@ -0,0 +1,14 @@
+#!/bin/sh
+set -e
+
+echo .
+for i in a b c; do
+	mkdir -p "$i/sub/subsub"
+	touch "$i/file" "$i/sub/file" "$i/sub/subsub/file"
+	echo "./$i"
+	echo "./$i/file"
+	echo "./$i/sub"
+	echo "./$i/sub/file"
+	echo "./$i/sub/subsub"
+	echo "./$i/sub/subsub/file"
+done
@@ -0,0 +1,4 @@
+#!/bin/sh
+# output is sorted for comparison, so complain about paths shallower than the
+# one before them
+/test/find -bfs . | awk -F / 'NF < depth { print "out of order: " $0 } { depth = NF; print }'
@@ -0,0 +1,6 @@
+#!/bin/sh
+# test-delete-run.sh deleted them already
+../test-delete-prepare.sh > /dev/null
+find . -name 'del*' -delete 2> /dev/null
+find tree -delete
+exec find .
@@ -0,0 +1,25 @@
+#!/bin/sh
+set -e
+
+echo .
+
+mkdir -p keep
+echo ./keep
+touch keep/file
+echo ./keep/file
+touch keep/del-file
+mkdir -p keep/del-dir/del-sub
+touch keep/del-dir/del-a keep/del-dir/del-sub/del-b
+
+mkdir -p full/del-full
+echo ./full
+echo ./full/del-full
+touch full/del-full/file
+echo ./full/del-full/file
+echo "/test/find: cannot delete ./full/del-full: Directory not empty"
+
+# removed as a whole by several threads
+for i in 1 2 3 4 5 6 7 8; do
+	mkdir -p tree/$i/a/b
+	touch tree/$i/file tree/$i/a/b/file
+done
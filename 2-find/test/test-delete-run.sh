@@ -0,0 +1,4 @@
+#!/bin/sh
+/test/find . -name 'del*' -delete
+/test/find tree -threads 4 -delete
+exec /test/find .
@@ -0,0 +1,2 @@
+#!/bin/sh
+exec find . -mindepth 2 -maxdepth 3
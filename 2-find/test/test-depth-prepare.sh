@@ -0,0 +1,10 @@
+#!/bin/sh
+set -e
+
+mkdir -p a/b/c/d
+touch a/file a/b/file a/b/c/file
+
+echo ./a/b
+echo ./a/file
+echo ./a/b/c
+echo ./a/b/file
@@ -0,0 +1,2 @@
+#!/bin/sh
+/test/find . -mindepth 2 -maxdepth 3
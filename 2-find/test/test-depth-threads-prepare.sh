@@ -0,0 +1,18 @@
+#!/bin/sh
+set -e
+
+# enough directories that the threads finish them in a different order than
+# they started, and long names that fill the output buffers several times
+n=a_long_name_that_makes_the_output_of_every_thread_much_bigger
+for a in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20; do
+	for b in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20; do
+		mkdir -p d$a/d$b
+		for f in 1 2 3 4 5 6 7 8; do
+			touch d$a/d$b/$n$f
+			echo ./d$a/d$b/$n$f
+		done
+		echo ./d$a/d$b
+	done
+	echo ./d$a
+done
+echo .
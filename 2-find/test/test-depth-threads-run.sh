@@ -0,0 +1,15 @@
+#!/bin/sh
+# the output is sorted for comparison, so check here that no path comes after
+# one of its directories, even when stdout is a pipe
+/test/find . -threads 4 -depth | awk '
+{
+	for(p = $0; (i = match(p, /\/[^\/]*$/)) > 0;) {
+		p = substr(p, 1, i - 1)
+		if(p in seen) {
+			print "after its directory: " $0
+			break
+		}
+	}
+	seen[$0] = 1
+	print
+}'
@@ -0,0 +1,12 @@
+#!/bin/sh
+set -e
+
+echo .
+echo ./a
+echo ./a/b
+
+# a proc mount is visited, but nothing in it
+echo /proc
+
+mkdir -p a
+touch a/b
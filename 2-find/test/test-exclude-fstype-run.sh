@@ -0,0 +1,2 @@
+#!/bin/sh
+exec /test/find . /proc -exclude-fstype proc
@@ -0,0 +1,3 @@
+#!/bin/sh
+find . -type f -exec printf '%s\n' {} +
+find . -name b -execdir printf 'dir %s\n' {} \;
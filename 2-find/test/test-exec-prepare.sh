@@ -0,0 +1,11 @@
+#!/bin/sh
+set -e
+
+mkdir -p a/b
+touch a/file a/b/file top
+
+echo ./a/file
+echo ./a/b/file
+echo ./top
+# -execdir gets the name relative to the file's directory
+echo 'dir ./b'
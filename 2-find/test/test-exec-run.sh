@@ -0,0 +1,3 @@
+#!/bin/sh
+/test/find . -type f -exec printf '%s\n' {} +
+/test/find . -name b -execdir printf 'dir %s\n' {} \;
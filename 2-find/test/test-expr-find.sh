@@ -0,0 +1,2 @@
+#!/bin/sh
+exec find . -name skip -prune -o \( -type f -size +1k -o -type l -o -name '*.txt' ! -name other.txt \) -print
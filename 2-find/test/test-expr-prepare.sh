@@ -0,0 +1,13 @@
+#!/bin/sh
+set -e
+
+mkdir -p a/skip/deep b
+head -c 2000 /dev/zero > a/big
+touch a/small a/skip/file a/skip/deep/file b/small.txt b/other.txt
+ln -s small a/link
+
+# everything except the pruned skip/, regular files larger than 1k, or
+# symlinks, or names ending in .txt that are not "other.txt"
+echo ./a/big
+echo ./a/link
+echo ./b/small.txt
@@ -0,0 +1,15 @@
+#!/bin/sh
+set -e
+
+# deeper than the file descriptors test-fd-budget-run.sh allows, with siblings
+# that are read after the deep directories were left
+echo .
+dir=.
+for i in $(seq 100); do
+	mkdir "$dir/d" "$dir/e"
+	touch "$dir/e/file"
+	echo "$dir/d"
+	echo "$dir/e"
+	echo "$dir/e/file"
+	dir="$dir/d"
+done
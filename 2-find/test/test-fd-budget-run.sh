@@ -0,0 +1,3 @@
+#!/bin/sh
+ulimit -n 16
+exec /test/find .
@@ -0,0 +1,18 @@
+#!/bin/sh
+set -e
+
+mkdir needle
+echo 'a needle in a haystack' > a
+echo 'only hay' > b
+ln -s a link
+# mmap(2)ed
+head -c 300000 /dev/zero > c
+echo needle >> c
+# read with pread(2), the match crosses the end of the first chunk
+head -c 65533 /dev/zero > d
+echo needle >> d
+head -c 65533 /dev/zero > e
+
+echo ./a
+echo ./c
+echo ./d
@@ -0,0 +1,17 @@
+#!/bin/sh
+set -e
+
+for i in a b c; do
+	mkdir -p "$i/sub"
+	touch "$i/file" "$i/sub/file" "$i/old"
+done
+# old enough to be taken from the index when it is refreshed
+touch -d 2000-01-01 a a/sub b b/sub c c/sub .
+
+# test-index-run.sh changes a and b between building and refreshing the index
+for i in a b c; do
+	echo "./$i/file"
+	echo "./$i/sub/file"
+done
+echo ./a/new
+echo ./c/old
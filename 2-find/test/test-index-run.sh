@@ -0,0 +1,9 @@
+#!/bin/sh
+set -e
+index=$(mktemp)
+trap 'rm -f "$index"' EXIT
+/test/find -build-index "$index" .
+touch a/new
+rm a/old b/old
+/test/find -build-index "$index" .
+/test/find -index "$index" -type f .
@@ -0,0 +1,2 @@
+#!/bin/sh
+find . -type f -size +0 | tr / '\001' | LC_ALL=C sort | tr '\001' / | awk '{ print NR " " $0 }'
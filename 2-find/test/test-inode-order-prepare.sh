@@ -0,0 +1,22 @@
+#!/bin/sh
+set -e
+
+# more entries than a batch of `-inode-order`, created in reverse so their
+# inodes are not in the order of their names
+i=1500
+while [ $i -gt 0 ]; do
+	if [ $((i % 3)) -eq 0 ]; then
+		echo x > f$i
+	else
+		touch f$i
+	fi
+	i=$((i - 1))
+done
+mkdir d
+echo x > d/f
+
+for f in d/f $(ls | grep '^f' | LC_ALL=C sort); do
+	if [ -s "$f" ]; then
+		echo "./$f"
+	fi
+done | awk '{ print NR " " $0 }'
@@ -0,0 +1,3 @@
+#!/bin/sh
+# the entries are stat(2)ed in inode order, but printed sorted by name
+/test/find -sorted -inode-order . -type f -size +0 | awk '{ print NR " " $0 }'
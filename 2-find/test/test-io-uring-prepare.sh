@@ -0,0 +1,14 @@
+#!/bin/sh
+set -e
+
+# directories are opened ahead, files are stat(2)ed in batches, or without
+# io_uring(7) (e.g. blocked by seccomp) the same happens synchronously
+for d in a b c; do
+	mkdir -p $d/x $d/y/z
+	echo x > $d/x/f
+	touch $d/y/z/empty
+	echo "./$d/x/f"
+done
+mkdir d
+chmod a-rwx d
+echo "/test/find: cannot open ./d: Permission denied"
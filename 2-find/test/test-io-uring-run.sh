@@ -0,0 +1,2 @@
+#!/bin/sh
+exec /test/find -io-uring . -type f -size +0
@@ -0,0 +1,3 @@
+#!/bin/sh
+find .
+find . -print -name skip -prune
@@ -0,0 +1,15 @@
+#!/bin/sh
+set -e
+
+mkdir -p a/b/c a/skip/deep b/skip empty
+touch a/file a/b/c/file a/skip/file a/skip/deep/file b/skip/file
+
+# without -prune
+for p in . ./a ./a/b ./a/b/c ./a/b/c/file ./a/file ./a/skip ./a/skip/deep ./a/skip/deep/file ./a/skip/file ./b ./b/skip ./b/skip/file ./empty; do
+	echo "$p"
+done
+# with -prune skip, the pruned directories are still returned
+for p in . ./a ./a/b ./a/b/c ./a/b/c/file ./a/file ./a/skip ./b ./b/skip ./empty; do
+	echo "$p"
+done
+echo "/test/test/iter: stopped after 4 files"
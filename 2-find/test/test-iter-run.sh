@@ -0,0 +1,5 @@
+#!/bin/sh
+# the pull iterator of libfind, see iter.c
+/test/test/iter .
+/test/test/iter -prune skip .
+/test/test/iter -stop 4 .
@@ -0,0 +1,3 @@
+#!/bin/sh
+# sorting with / as the smallest character gives pre-order with sorted names
+find . -name d07 -prune -o -print | tr / '\001' | LC_ALL=C sort | tr '\001' / | awk '{ print NR " " $0 }'
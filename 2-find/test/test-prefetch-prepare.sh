@@ -0,0 +1,18 @@
+#!/bin/sh
+set -e
+
+# more directories than the look-ahead window, and a pruned one that was
+# prefetched but is never read
+echo '1 .'
+n=2
+for i in 01 02 03 04 05 06 07 08 09 10 11 12 13 14 15 16 17 18 19 20; do
+	mkdir -p d$i/x/y
+	touch d$i/f
+	if [ $i = 07 ]; then
+		continue
+	fi
+	for p in d$i d$i/f d$i/x d$i/x/y; do
+		echo "$n ./$p"
+		n=$((n + 1))
+	done
+done
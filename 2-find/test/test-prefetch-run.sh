@@ -0,0 +1,3 @@
+#!/bin/sh
+# number the lines, because the output is sorted for comparison
+/test/find -sorted -prefetch 2 . -name d07 -prune -o -print | awk '{ print NR " " $0 }'
@@ -0,0 +1,16 @@
+#!/bin/sh
+set -e
+
+# -run.sh and -find.sh replace newlines with ? and NUL bytes with newlines
+
+echo .
+
+mkdir a
+echo ./a
+
+touch 'a/b
+c'
+echo './a/b?c'
+
+touch d
+echo ./d
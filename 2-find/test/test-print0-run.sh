@@ -0,0 +1,2 @@
+#!/bin/sh
+/test/find . -print0 | tr '\n\0' '?\n'
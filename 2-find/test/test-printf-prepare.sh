@@ -0,0 +1,16 @@
+#!/bin/sh
+set -e
+
+mkdir -p a/b
+printf hello > a/file
+touch -d @1600000000.25 a/file
+: > a/b/empty
+touch -d @1500000000 a/b/empty
+ln -s file a/link
+
+echo ". . 0 d"
+echo "./a a 1 d"
+echo "./a/b b 2 d"
+echo "./a/file file 2 f 5 1600000000.2500000000 $(stat -c %i a/file)"
+echo "./a/b/empty empty 3 f 0 1500000000.0000000000 $(stat -c %i a/b/empty)"
+echo "./a/link link 2 l"
@@ -0,0 +1,2 @@
+#!/bin/sh
+exec /test/find . -type d -printf '%p %f %d %y\n' -o -type l -printf '%p %f %d %y\n' -o -printf '%p %f %d %y %s %T@ %i\n'
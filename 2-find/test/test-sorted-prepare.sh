@@ -0,0 +1,15 @@
+#!/bin/sh
+set -e
+
+# "b.txt" sorts before "b/c" as a path, but after "b" as a name
+mkdir -p b/c a
+touch b.txt b/c/z b/a a/b
+
+echo '1 .'
+echo '2 ./a'
+echo '3 ./a/b'
+echo '4 ./b'
+echo '5 ./b/a'
+echo '6 ./b/c'
+echo '7 ./b/c/z'
+echo '8 ./b.txt'
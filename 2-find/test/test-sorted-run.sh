@@ -0,0 +1,3 @@
+#!/bin/sh
+# number the lines, because the output is sorted for comparison
+/test/find -sorted . | awk '{ print NR " " $0 }'
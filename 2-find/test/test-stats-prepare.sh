@@ -0,0 +1,10 @@
+#!/bin/sh
+set -e
+
+mkdir a
+touch a/file b
+
+echo 'directories opened: 2'
+echo 'entries read: 3'
+echo 'matches: 4'
+echo 'errors: 0'
@@ -0,0 +1,19 @@
+#!/bin/sh
+set -e
+
+echo .
+
+for i in 1 2 3 4 5 6 7 8; do
+	mkdir "$i"
+	echo "./$i"
+	for j in a b c d; do
+		mkdir "$i/$j"
+		echo "./$i/$j"
+		touch "$i/$j/file"
+		echo "./$i/$j/file"
+	done
+done
+
+# the loop is detected, although its parent was traversed by another thread
+ln -s ../.. 8/d/loop
+echo "/test/find: file system loop detected: ./8/d/loop = ."
@@ -0,0 +1,2 @@
+#!/bin/sh
+exec /test/find -threads 4 -follow .
@@ -0,0 +1,2 @@
+#!/bin/sh
+exec find -L . \( -path ./l2 -o -path ./real \) -prune -print -o -print
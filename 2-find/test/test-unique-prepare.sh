@@ -0,0 +1,17 @@
+#!/bin/sh
+set -e
+
+# l1 and l2 are the same directory as real, it is only traversed through l1,
+# which comes first with -sorted
+mkdir -p real/sub
+touch real/g real/sub/f
+ln -s real l1
+ln -s real l2
+
+echo .
+echo ./l1
+echo ./l1/g
+echo ./l1/sub
+echo ./l1/sub/f
+echo ./l2
+echo ./real
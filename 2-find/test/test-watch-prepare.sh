@@ -0,0 +1,11 @@
+#!/bin/sh
+set -e
+
+mkdir a
+touch a/old.c a/old.h
+echo ./a/old.c
+
+# created by test-watch-run.sh while find is watching
+echo ./a/new.c
+echo ./a/moved.c
+echo ./b/c/deep.c
@@ -0,0 +1,13 @@
+#!/bin/sh
+/test/find -watch . -name '*.c' &
+pid=$!
+sleep 1
+touch a/new.c a/new.h
+mv a/old.h a/moved.c
+# a new subtree is moved in at once, so it is traversed exactly once
+mkdir -p ../test-watch.tmp/b/c
+touch ../test-watch.tmp/b/c/deep.c
+mv ../test-watch.tmp/b .
+rmdir ../test-watch.tmp
+sleep 1
+kill $pid
@@ -0,0 +1,216 @@
+#define _GNU_SOURCE  // syscall
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "uring.h"
+
+/**
+ *  Whether the kernel supports `IORING_OP_STATX` and `IORING_OP_OPENAT`.
+ */
+static int uring_probe(int fd) {
+	size_t nops = IORING_OP_LAST;
+	struct io_uring_probe *probe = calloc(1, sizeof(*probe) + nops * sizeof(probe->ops[0]));
+	if(!probe) {
+		return -1;
+	}
+	int ret = -1;
+	if(syscall(SYS_io_uring_register, fd, IORING_REGISTER_PROBE, probe, nops) < 0) {
+		goto out;
+	}
+	if(
+		probe->last_op < IORING_OP_STATX
+		|| probe->last_op < IORING_OP_OPENAT
+		|| !(probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED)
+		|| !(probe->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED)
+	) {
+		errno = ENOSYS;
+		goto out;
+	}
+	ret = 0;
+out:
+	free(probe);
+	return ret;
+}
+
+/**
+ *  Set up a ring with `URING_ENTRIES` entries. Returns -1 with `errno` set if
+ *  io_uring(7) is not available, e.g. an old kernel, `io_uring_disabled` or a
+ *  seccomp profile that blocks it.
+ */
+int uring_init(struct uring *r) {
+	*r = (struct uring){
+		.fd = -1,
+		.sq_ring = MAP_FAILED,
+		.cq_ring = MAP_FAILED,
+		.sqes = MAP_FAILED,
+	};
+	struct io_uring_params p = {0};
+	r->fd = syscall(SYS_io_uring_setup, URING_ENTRIES, &p);
+	if(r->fd < 0 || uring_probe(r->fd) < 0) {
+		goto fail;
+	}
+
+	r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if(p.features & IORING_FEAT_SINGLE_MMAP) {
+		if(r->cq_ring_size > r->sq_ring_size) {
+			r->sq_ring_size = r->cq_ring_size;
+		}
+		r->cq_ring_size = 0;
+	}
+	r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if(r->sq_ring == MAP_FAILED) {
+		goto fail;
+	}
+	if(r->cq_ring_size) {
+		r->cq_ring = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+		if(r->cq_ring == MAP_FAILED) {
+			goto fail;
+		}
+	}
+	r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if(r->sqes == MAP_FAILED) {
+		goto fail;
+	}
+
+	char *sq = r->sq_ring;
+	char *cq = r->cq_ring_size ? r->cq_ring : r->sq_ring;
+	r->sq_entries = p.sq_entries;
+	r->sq_head = (unsigned *)(sq + p.sq_off.head);
+	r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	r->sq_array = (unsigned *)(sq + p.sq_off.array);
+	r->cq_head = (unsigned *)(cq + p.cq_off.head);
+	r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	return 0;
+
+fail:;
+	int errbak = errno;
+	uring_free(r);
+	errno = errbak;
+	return -1;
+}
+
+void uring_free(struct uring *r) {
+	if(r->sqes != MAP_FAILED) {
+		munmap(r->sqes, r->sqes_size);
+	}
+	if(r->cq_ring_size && r->cq_ring != MAP_FAILED) {
+		munmap(r->cq_ring, r->cq_ring_size);
+	}
+	if(r->sq_ring != MAP_FAILED) {
+		munmap(r->sq_ring, r->sq_ring_size);
+	}
+	if(r->fd >= 0) {
+		close(r->fd);
+	}
+	r->fd = -1;
+	r->sq_ring = MAP_FAILED;
+	r->cq_ring = MAP_FAILED;
+	r->sqes = MAP_FAILED;
+}
+
+/**
+ *  Return the next free submission queue entry, or NULL if the queue is full.
+ *  We are the only producer, so only the head the kernel consumes from needs
+ *  an atomic load.
+ */
+static struct io_uring_sqe *uring_sqe(struct uring *r) {
+	unsigned tail = *r->sq_tail;
+	if(tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= r->sq_entries) {
+		errno = EAGAIN;
+		return NULL;
+	}
+	unsigned i = tail & *r->sq_mask;
+	struct io_uring_sqe *sqe = &r->sqes[i];
+	memset(sqe, 0, sizeof(*sqe));
+	r->sq_array[i] = i;
+	return sqe;
+}
+
+static void uring_queue(struct uring *r) {
+	__atomic_store_n(r->sq_tail, *r->sq_tail + 1, __ATOMIC_RELEASE);
+	++r->queued;
+}
+
+/**
+ *  Queue statx(2) of `name` relative to `dir_fd` into `stx`. `data` is
+ *  returned by `uring_complete`. `name` and `stx` must stay valid until then.
+ */
+int uring_statx(struct uring *r, int dir_fd, const char *name, int flags, unsigned mask, struct statx *stx, uint64_t data) {
+	struct io_uring_sqe *sqe = uring_sqe(r);
+	if(!sqe) {
+		return -1;
+	}
+	sqe->opcode = IORING_OP_STATX;
+	sqe->fd = dir_fd;
+	sqe->addr = (uintptr_t)name;
+	sqe->len = mask;
+	sqe->off = (uintptr_t)stx;
+	sqe->statx_flags = flags;
+	sqe->user_data = data;
+	uring_queue(r);
+	return 0;
+}
+
+/**
+ *  Queue openat(2) of `name` relative to `dir_fd`, the completion's result is
+ *  the file descriptor.
+ */
+int uring_openat(struct uring *r, int dir_fd, const char *name, int flags, uint64_t data) {
+	struct io_uring_sqe *sqe = uring_sqe(r);
+	if(!sqe) {
+		return -1;
+	}
+	sqe->opcode = IORING_OP_OPENAT;
+	sqe->fd = dir_fd;
+	sqe->addr = (uintptr_t)name;
+	sqe->open_flags = flags;
+	sqe->user_data = data;
+	uring_queue(r);
+	return 0;
+}
+
+/**
+ *  Submit the queued entries with one io_uring_enter(2) and wait until at
+ *  least `wait` completions are available.
+ */
+int uring_submit(struct uring *r, unsigned wait) {
+	while(r->queued || wait) {
+		int n = syscall(SYS_io_uring_enter, r->fd, r->queued, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		r->queued -= n;
+		if(!r->queued) {
+			break;
+		}
+	}
+	return 0;
+}
+
+/**
+ *  Take the next completion, storing its `data` and its result, which is
+ *  `-errno` on failure. Returns 0 if there is none.
+ */
+int uring_complete(struct uring *r, uint64_t *data, int *res) {
+	unsigned head = *r->cq_head;
+	if(head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+		return 0;
+	}
+	const struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+	*data = cqe->user_data;
+	*res = cqe->res;
+	__atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+	return 1;
+}
@@ -0,0 +1,53 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+/**
+ *  Submission queue entries of a `struct uring`, a batch of `-io-uring` is
+ *  submitted in chunks of at most this many operations.
+ */
+#define URING_ENTRIES 256
+
+struct statx;
+
+/**
+ *  A minimal io_uring(7) without liburing: the submission and completion
+ *  rings mapped from the kernel. `sq_*` and `cq_*` point into the mapped
+ *  rings, `queued` are the entries queued since the last `uring_submit`.
+ */
+struct uring {
+	int fd;
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	unsigned sq_entries;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+	unsigned queued;
+};
+
+int uring_init(struct uring *r);
+
+void uring_free(struct uring *r);
+
+int uring_statx(struct uring *r, int dir_fd, const char *name, int flags, unsigned mask, struct statx *stx, uint64_t data);
+
+int uring_openat(struct uring *r, int dir_fd, const char *name, int flags, uint64_t data);
+
+int uring_submit(struct uring *r, unsigned wait);
+
+int uring_complete(struct uring *r, uint64_t *data, int *res);
+
+#endif
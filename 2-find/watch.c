@@ -0,0 +1,89 @@
+#define _GNU_SOURCE  // strdup
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "watch.h"
+
+int watch_init(struct watch *w) {
+	*w = (struct watch){0};
+	w->fd = inotify_init1(IN_CLOEXEC);
+	return w->fd < 0 ? -1 : 0;
+}
+
+void watch_free(struct watch *w) {
+	for(size_t i = 0; i < w->ndirs; ++i) {
+		free(w->dirs[i].path);
+	}
+	free(w->dirs);
+	if(w->fd >= 0) {
+		close(w->fd);
+	}
+	*w = (struct watch){.fd = -1};
+}
+
+/**
+ *  Watch the directory `path`. A directory that is watched already, e.g.
+ *  through a symlink with `-follow`, gets the same watch descriptor, and the
+ *  path it was seen under last.
+ */
+int watch_add(struct watch *w, const char *path, size_t depth, dev_t xdev) {
+	int wd = inotify_add_watch(w->fd, path, WATCH_EVENTS);
+	if(wd < 0) {
+		return -1;
+	}
+	if((size_t)wd >= w->ndirs) {
+		size_t n = w->ndirs ? w->ndirs : 64;
+		while((size_t)wd >= n) {
+			n *= 2;
+		}
+		struct watch_dir *dirs = realloc(w->dirs, n * sizeof(*dirs));
+		if(!dirs) {
+			goto fail;
+		}
+		memset(dirs + w->ndirs, 0, (n - w->ndirs) * sizeof(*dirs));
+		w->dirs = dirs;
+		w->ndirs = n;
+	}
+	char *copy = strdup(path);
+	if(!copy) {
+		goto fail;
+	}
+	free(w->dirs[wd].path);
+	w->dirs[wd] = (struct watch_dir){
+		.path = copy,
+		.depth = depth,
+		.xdev = xdev,
+	};
+	return 0;
+
+fail:;
+	int errbak = errno;
+	inotify_rm_watch(w->fd, wd);
+	errno = errbak;
+	return -1;
+}
+
+/**
+ *  Return the directory of an event's watch descriptor, or `NULL` if it is
+ *  not watched anymore.
+ */
+const struct watch_dir *watch_get(const struct watch *w, int wd) {
+	if(wd < 0 || (size_t)wd >= w->ndirs || !w->dirs[wd].path) {
+		return NULL;
+	}
+	return &w->dirs[wd];
+}
+
+/**
+ *  Forget a watch after `IN_IGNORED`, because its directory was deleted or
+ *  its file system unmounted.
+ */
+void watch_remove(struct watch *w, int wd) {
+	if(wd >= 0 && (size_t)wd < w->ndirs) {
+		free(w->dirs[wd].path);
+		w->dirs[wd].path = NULL;
+	}
+}
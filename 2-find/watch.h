@@ -0,0 +1,47 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stddef.h>
+#include <sys/inotify.h>
+#include <sys/types.h>
+
+/**
+ *  A directory watched by `-watch`: its path and depth, and the `st_dev` of
+ *  `-xdev` of the root it was found under.
+ */
+struct watch_dir {
+	char *path;
+	size_t depth;
+	dev_t xdev;
+};
+
+/**
+ *  An inotify(7) instance with the directories `find` traversed. `dirs` is
+ *  indexed by watch descriptor, the kernel hands them out counting up from 1,
+ *  a `path` of `NULL` is not watched. `full` is set once the limit of watches
+ *  was reached, so it is only reported once.
+ */
+struct watch {
+	int fd;
+	struct watch_dir *dirs;
+	size_t ndirs;
+	int full;
+};
+
+/**
+ *  The events `-watch` asks for: entries created in or moved into a watched
+ *  directory. `IN_IGNORED` is always reported when a watch is gone.
+ */
+#define WATCH_EVENTS (IN_CREATE | IN_MOVED_TO | IN_ONLYDIR)
+
+int watch_init(struct watch *w);
+
+void watch_free(struct watch *w);
+
+int watch_add(struct watch *w, const char *path, size_t depth, dev_t xdev);
+
+const struct watch_dir *watch_get(const struct watch *w, int wd);
+
+void watch_remove(struct watch *w, int wd);
+
+#endif